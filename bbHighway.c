@@ -11,17 +11,42 @@
     To build and run, use the following command: mingw32-make debug && bbHighway.exe
     -> The debug part is optional. Remove it if you don't want to debug: mingw32-make && bbHighway.exe
 
+    To check the move generator & get a speed number: make bench (runs bbHighway perft 5 with both slider backends)
+    Release builds (make, make bench) first run "make tables" to write the attack tables into attack_tables.h
+    make shared builds the smaller (~260 KB) shared-entry slider table instead, make slidebench compares the two
+    make magics searches new magic numbers (into magic_numbers.h) & builds the engine with them
+    NNUE evaluation: setoption name EvalFile value <network file> (see NNUE), make nnuebench times it
+
 ===========================================
 \******************************************/
 
 // System Headers
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <locale.h>
+#include <pthread.h>
 
 #ifdef _WIN64
     #include <windows.h>
+#else
+    #include <sys/time.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__x86_64__)
+    #include <immintrin.h>
+    #include <cpuid.h>
+#endif
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
 #endif
 
 // Define bitboard data type
@@ -46,9 +71,9 @@
 // Set + get + pop Macros
 
 // Is the bit available (0, I think) at the target square?
-#define get_bit(bitboard, square) (bitboard & (1ULL << square))
+#define get_bit(bitboard, square) ((bitboard) & (1ULL << (square)))
 // Set the bit at the target square to 1 (I think)
-#define set_bit(bitboard, square) (bitboard |= (1ULL) << square)
+#define set_bit(bitboard, square) ((bitboard) |= (1ULL << (square)))
 // Set the bit at the target square at 0
 #define pop_bit(bitboard, square) ((bitboard) &= ~(1ULL << (square)))
 
@@ -79,7 +104,7 @@ static inline int CMK_get_ls1b_index(U64 bitboard) {
     // Make sure that the bitboard isn't 0
     if (bitboard) {
         // Count trailing bits before LS1B
-        return BK_count_bits((bitboard & ~bitboard + 1) - 1);
+        return BK_count_bits((bitboard & (~bitboard + 1)) - 1);
     } else {
         // Return illegal index
         return -1;
@@ -130,18 +155,6 @@ const char *square_to_coordinates[] = {
 };
 
 
-// define piece bitboards
-U64 bitboards[12]; // 6 bitboards for each piece on each side
-
-// Occupancy bitboards
-U64 occupancies[3]; // White, black, and both sides occupancies
-
-// side to move
-int side;
-
-// enpassant square
-int enpassant = no_sq;
-
 // castling rights (4 bit flag)
 /*  Castling Bits Binary Representation
 
@@ -159,12 +172,130 @@ int enpassant = no_sq;
 /// Castling enumerations
 enum { wk = 1, wq = 2, bk = 4, bq = 8 };
 
-int castle;
+// Maximum number of moves that can be made without taking them back -> game history + search depth
+#define MAX_HISTORY 1024
+
+// Maximum number of moves in a move list -> the most moves ever found in a legal position is 218, so 256 leaves some headroom for pseudo-legal moves
+#define MAX_MOVES 256
+
+// Undo record -> everything take_back() needs to get the previous position back (see Make & Take Back)
+typedef struct {
+#ifdef COPY_MAKE
+    // Full board snapshot
+    U64 bitboards[12];
+    U64 occupancies[3];
+    int side;
+    int full_moves;
+#endif
+    // Hash keys before the move
+    U64 hash_key;
+    U64 pawn_key;
+
+    // Material & piece-square score & game phase before the move
+    int psq_score;
+    int phase;
+
+    // The move that was made
+    int move;
+
+    // Captured piece (-1 if nothing got captured)
+    signed char captured;
+
+    // State that the move itself can't tell us about
+    unsigned char enpassant;
+    unsigned char castle;
+
+    // FEN counters go up to 9999 (& keep counting from there) -> needs more than a byte
+    unsigned short half_moves;
+} undo;
+
+// Cache line size -> positions (and anything else that gets handed out to different threads) are aligned to it,
+// so two boards never share a cache line
+#define CACHE_LINE_SIZE 64
+
+// NNUE accumulator width (see NNUE)
+#define NNUE_HIDDEN 256
+
+// NNUE accumulators -> the network's first layer for white's & black's point of view [side][neuron]
+typedef struct __attribute__((aligned(CACHE_LINE_SIZE))) {
+    short values[2][NNUE_HIDDEN];
+} nnue_accumulator;
+
+// Position -> the whole board state. Everything that looks at or plays on a board takes a pointer to one,
+// so every thread (or game) can have its own board while the attack tables stay shared.
+// The fields move generation reads all the time come first, so they sit in the first cache lines of the struct.
+typedef struct __attribute__((aligned(CACHE_LINE_SIZE))) {
+    // define piece bitboards
+    U64 bitboards[12]; // 6 bitboards for each piece on each side
+
+    // Occupancy bitboards
+    U64 occupancies[3]; // White, black, and both sides occupancies
+
+    // side to move
+    int side;
+
+    // enpassant square
+    int enpassant;
+
+    // castling rights (4 bit flag, see above)
+    int castle;
+
+    // Half-moves and full-moves
+    int half_moves;
+    int full_moves;
+
+    // Zobrist hash key & the key of the pawns alone (see Zobrist Keys)
+    U64 hash_key;
+    U64 pawn_key;
+
+    // Material & piece-square score (middlegame & endgame packed together) & game phase, kept up to date by
+    // make_move (see Incremental Evaluation)
+    int psq_score;
+    int phase;
+
+    // NNUE accumulators, kept up to date by make_move & take_back while a network is in use (see NNUE)
+    nnue_accumulator accumulator;
+
+    // Undo stack & the number of records on it
+    int undo_count;
+    undo undo_stack[MAX_HISTORY];
+} position;
+
+// NNUE modes (see NNUE) -> off (hand-written evaluation), accumulators updated by make_move/take_back, or rebuilt at every evaluation
+// (only there to measure what the incremental updates save)
+enum { nnue_off, nnue_incremental, nnue_refresh };
+int nnue_mode = nnue_off;
+
+// Rebuild a position's NNUE accumulators from the board (see NNUE)
+void nnue_refresh_accumulators(position *pos);
 
-// Half-moves and full-moves
-int half_moves;
+// Allocate zeroed, cache line aligned memory (plain malloc only guarantees 16 byte alignment, which isn't enough for position)
+void *aligned_calloc(size_t count, size_t size) {
+    void *memory;
+    #ifdef _WIN64
+        memory = _aligned_malloc(count * size, CACHE_LINE_SIZE);
+    #else
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, count * size)) {
+            memory = NULL;
+        }
+    #endif
+
+    // Zero the memory
+    if (memory != NULL) {
+        memset(memory, 0, count * size);
+    }
+
+    return memory;
+}
 
-int full_moves;
+// Free memory from aligned_calloc
+void aligned_free(void *memory) {
+    #ifdef _WIN64
+        _aligned_free(memory);
+    #else
+        free(memory);
+    #endif
+}
 
 // ASCII pieces
 /// Can be indexed by the piece enumeration (see above)
@@ -246,12 +377,173 @@ U64 get_random_U64_number() {
     return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
 }
 
-// Generate magic number candidate
-U64 generate_magic_number() {
-    return get_random_U64_number() & get_random_U64_number() & get_random_U64_number();
+
+
+
+/******************************************\
+===========================================
+
+                Zobrist Keys
+
+===========================================
+\******************************************/
+
+/*
+    Zobrist hashing -> every (piece, square) pair, every en passant square, every castling rights combination & the side to
+    move get a random 64-bit key. A position's hash key is the XOR of the keys of everything that's true about it, so a move
+    only has to XOR out what it changes & XOR in what it adds (see make_move). Build with -DDEBUG_HASH to check the
+    incrementally updated key against a full recomputation after every move.
+
+    The pawn key only hashes the pawns (with the same piece keys), so it only changes on pawn moves, pawn captures &
+    promotions -> the pawn structure evaluation gets cached under it (see the pawn hash table).
+*/
+
+// Random piece keys [piece][square]
+U64 piece_keys[12][64];
+
+// Random en passant keys [square]
+U64 enpassant_keys[64];
+
+// Random castling keys [castling rights]
+U64 castle_keys[16];
+
+// Random side key -> XORed in when black is to move
+U64 side_key;
+
+// Generate a random hash key -> the XOR shift generator is linear (every number it gives is an XOR of bits of its 32-bit
+// state), so its raw numbers only span 32 bits worth of keys & XORs of them collide far too often. Running them through a
+// multiply/shift mixer (the SplitMix64 finalizer) breaks that linearity.
+U64 get_random_hash_key() {
+    U64 key = get_random_U64_number();
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+// Initialize the random hash keys
+void init_random_keys() {
+    // Reset the random state, so the keys are the same on every run
+    random_state = 1804289383;
+
+    // Loop over the pieces & squares
+    for (int piece = P; piece <= k; piece++) {
+        for (int square = 0; square < 64; square++) {
+            piece_keys[piece][square] = get_random_hash_key();
+        }
+    }
+
+    // Loop over the en passant squares
+    for (int square = 0; square < 64; square++) {
+        enpassant_keys[square] = get_random_hash_key();
+    }
+
+    // Loop over the castling rights combinations
+    for (int index = 0; index < 16; index++) {
+        castle_keys[index] = get_random_hash_key();
+    }
+
+    // Initialize the side key
+    side_key = get_random_hash_key();
+}
+
+// Generate the hash key of a position from scratch
+U64 generate_hash_key(position *pos) {
+    // Final hash key
+    U64 final_key = 0ULL;
+
+    // Loop over the piece bitboards
+    for (int piece = P; piece <= k; piece++) {
+        // Piece bitboard copy
+        U64 bitboard = pos->bitboards[piece];
+
+        // Hash every piece on the bitboard
+        while (bitboard) {
+            int square = get_ls1b_index(bitboard);
+            final_key ^= piece_keys[piece][square];
+            pop_bit(bitboard, square);
+        }
+    }
+
+    // Hash the en passant square
+    if (pos->enpassant != no_sq) {
+        final_key ^= enpassant_keys[pos->enpassant];
+    }
+
+    // Hash the castling rights
+    final_key ^= castle_keys[pos->castle];
+
+    // Hash the side (only when black is to move)
+    if (pos->side == black) {
+        final_key ^= side_key;
+    }
+
+    return final_key;
+}
+
+// Generate the pawn key of a position from scratch
+U64 generate_pawn_key(position *pos) {
+    U64 final_key = 0ULL;
+
+    // Hash every pawn of both sides
+    for (int piece = P; piece <= p; piece += p - P) {
+        U64 bitboard = pos->bitboards[piece];
+        while (bitboard) {
+            int square = get_ls1b_index(bitboard);
+            final_key ^= piece_keys[piece][square];
+            pop_bit(bitboard, square);
+        }
+    }
+
+    return final_key;
 }
 
+/******************************************\
+===========================================
+
+          Incremental Evaluation
+
+===========================================
+\******************************************/
+
+/*
+    Material & piece-square scores only change where pieces move, so (just like the hash key) make_move keeps them up to
+    date with one add & one subtract per piece it moves, captures or promotes, & evaluate() reads them in O(1).
+
+    Middlegame & endgame scores are packed into one int (endgame in the upper 16 bits), so both get updated with a single
+    add. The game phase counts the pieces left (knights & bishops 1, rooks 2, queens 4 -> 24 at the start) & blends the two.
+*/
 
+// Pack a middlegame & an endgame score into one int & get them back out
+#define make_score(mg, eg) ((int)((unsigned int)(eg) << 16) + (mg))
+#define score_mg(score) ((int)(short)(score))
+#define score_eg(score) ((int)(short)((unsigned int)((score) + 0x8000) >> 16))
+
+// Game phase at the start
+#define MAX_PHASE 24
+
+// Game phase weights [piece]
+const int phase_values[12] = { 0, 1, 1, 2, 4, 0, 0, 1, 1, 2, 4, 0 };
+
+// Packed material + piece-square scores [piece][square] from white's point of view (black pieces count negative)
+// -> filled by init_piece_square_values (see Evaluation)
+int piece_square_values[12][64];
+
+// Compute the material & piece-square score & the game phase of a position from scratch
+void generate_evaluation(position *pos) {
+    pos->psq_score = 0;
+    pos->phase = 0;
+
+    // Loop over the piece bitboards
+    for (int piece = P; piece <= k; piece++) {
+        U64 bitboard = pos->bitboards[piece];
+        while (bitboard) {
+            int square = get_ls1b_index(bitboard);
+            pos->psq_score += piece_square_values[piece][square];
+            pos->phase += phase_values[piece];
+            pop_bit(bitboard, square);
+        }
+    }
+}
 
 /******************************************\
 ===========================================
@@ -291,7 +583,7 @@ void print_bitboard(U64 bitboard) {
 }
 
 // Print the board
-void print_board() {
+void print_board(position *pos) {
     // Print offset for prettification
     printf("\n");
     // Loop over the board ranks
@@ -306,7 +598,7 @@ void print_board() {
 
             // Loop over all piece bitboards
             for (int bb_piece = P; bb_piece <= k; bb_piece++) {
-                if (get_bit(bitboards[bb_piece], square)) { // If the current piece type and colour exists on the current square
+                if (get_bit(pos->bitboards[bb_piece], square)) { // If the current piece type and colour exists on the current square
                     piece = bb_piece;
                 }
             }
@@ -320,150 +612,429 @@ void print_board() {
     printf("\n     a b c d e f g h \n\n");
 
     // print side to move
-    printf("    Side:      %s\n", !side ? "White" : "Black");
+    printf("    Side:      %s\n", !pos->side ? "White" : "Black");
 
     // Print the enpassant square
-    printf("    Enpass:    %s\n", (enpassant != no_sq) ? square_to_coordinates[enpassant] : "Not Available");
+    printf("    Enpass:    %s\n", (pos->enpassant != no_sq) ? square_to_coordinates[pos->enpassant] : "Not Available");
 
     // Print castling rights
-    printf("    Castling:  %c%c%c%c\n", (castle & wk) ? 'K' : '-',
-                                           (castle & wq) ? 'Q' : '-',
-                                           (castle & bk) ? 'k' : '-',
-                                           (castle & bq) ? 'q' : '-');
+    printf("    Castling:  %c%c%c%c\n", (pos->castle & wk) ? 'K' : '-',
+                                           (pos->castle & wq) ? 'Q' : '-',
+                                           (pos->castle & bk) ? 'k' : '-',
+                                           (pos->castle & bq) ? 'q' : '-');
     
     // Print Half- & Full-moves
-    printf("    Halfmoves: %d\n    Fullmoves: %d\n\n", half_moves, full_moves);
+    printf("    Halfmoves: %d\n    Fullmoves: %d\n", pos->half_moves, pos->full_moves);
+
+    // Print the hash key
+    printf("    Hash key:  %llx\n\n", pos->hash_key);
 }
 
 // Reset the boards & state variables
-void reset_board() {
+void reset_board(position *pos) {
     // reset bitboards
-    memset(bitboards, 0ULL, sizeof(bitboards)); // piece bitboards (for both white and black)
-    memset(occupancies, 0ULL, sizeof(occupancies)); // side bitboards (white, black, and both)
+    memset(pos->bitboards, 0ULL, sizeof(pos->bitboards)); // piece bitboards (for both white and black)
+    memset(pos->occupancies, 0ULL, sizeof(pos->occupancies)); // side bitboards (white, black, and both)
 
     // Reset game state variables
-    side = white; // side to move
-    enpassant = no_sq;
-    castle = 0;
-    half_moves = 0;
-    full_moves = 0;
-}
-
-//  Parse FEN string
-void parse_fen(char *fen) {
-    // Reset board position and state variables
-    reset_board();
-
-    // loop over board ranks
-    for (int rank = 0; rank < 8; rank ++) {
-        for (int file = 0; file < 8; file ++) {
-            // Get current square
-            int square = rank * 8 + file;
+    pos->side = white; // side to move
+    pos->enpassant = no_sq;
+    pos->castle = 0;
+    pos->half_moves = 0;
+    pos->full_moves = 0;
+
+    pos->hash_key = 0ULL;
+    pos->pawn_key = 0ULL;
+    pos->psq_score = 0;
+    pos->phase = 0;
+
+    // Empty the undo stack
+    pos->undo_count = 0;
+}
+
+// Create a new (empty) position -> one per game, analysis session or thread; they don't share anything but the attack tables
+position *create_position() {
+    position *pos = aligned_calloc(1, sizeof(position));
+    if (pos != NULL) {
+        reset_board(pos);
+    }
+    return pos;
+}
+
+// Free a position from create_position
+void destroy_position(position *pos) {
+    aligned_free(pos);
+}
+
+/*
+    FEN parser -> table driven & bounds checked. It never reads past fen + length, so it can be pointed straight into a file
+    buffer, & it writes the position directly: the bitboards, occupancies, hash keys & evaluation terms are all filled in
+    on the one pass over the piece placement. The half & full move counters may be missing (EPD) & anything after the last
+    field (EPD operations, " moves ...") is ignored.
+
+    Checked: 8 ranks of exactly 8 squares, known piece letters, one king per side, no pawns on the back ranks, no more
+    pieces than the pawns could have promoted to, the side to move, castling letters (no repeats), an en passant square
+    behind a pawn that just moved 2 squares, counters of at most 4 digits & the side not to move not being in check (see
+    position_error). Castling rights without the king & rook on their starting squares get dropped.
+*/
+
+// FEN parser results
+enum {
+    fen_ok, fen_bad_board, fen_bad_kings, fen_bad_pawns, fen_bad_material, fen_bad_side, fen_bad_castling,
+    fen_bad_enpassant, fen_bad_counters, fen_king_capture
+};
+
+const char *fen_error_names[] = {
+    "ok", "bad piece placement", "not one king per side", "pawn on the 1st or 8th rank", "more pieces than promotions allow",
+    "bad side to move", "bad castling rights", "bad en passant square", "bad move counters", "side not to move in check"
+};
+
+// Piece placement character kinds
+#define FEN_PIECE 1
+#define FEN_EMPTY 2
+#define FEN_RANK 4
+
+// Piece placement character -> kind (0 = not allowed), the piece, the squares it covers & whether it's a pawn
+typedef struct {
+    unsigned char kind;
+    unsigned char piece;
+    unsigned char squares;
+    unsigned char pawn;
+} fen_code;
+
+const fen_code fen_board_codes[256] = {
+    ['P'] = { FEN_PIECE, P, 1, 1 }, ['N'] = { FEN_PIECE, N, 1, 0 }, ['B'] = { FEN_PIECE, B, 1, 0 },
+    ['R'] = { FEN_PIECE, R, 1, 0 }, ['Q'] = { FEN_PIECE, Q, 1, 0 }, ['K'] = { FEN_PIECE, K, 1, 0 },
+    ['p'] = { FEN_PIECE, p, 1, 1 }, ['n'] = { FEN_PIECE, n, 1, 0 }, ['b'] = { FEN_PIECE, b, 1, 0 },
+    ['r'] = { FEN_PIECE, r, 1, 0 }, ['q'] = { FEN_PIECE, q, 1, 0 }, ['k'] = { FEN_PIECE, k, 1, 0 },
+    ['1'] = { FEN_EMPTY, 0, 1, 0 }, ['2'] = { FEN_EMPTY, 0, 2, 0 }, ['3'] = { FEN_EMPTY, 0, 3, 0 },
+    ['4'] = { FEN_EMPTY, 0, 4, 0 }, ['5'] = { FEN_EMPTY, 0, 5, 0 }, ['6'] = { FEN_EMPTY, 0, 6, 0 },
+    ['7'] = { FEN_EMPTY, 0, 7, 0 }, ['8'] = { FEN_EMPTY, 0, 8, 0 },
+    ['/'] = { FEN_RANK, 0, 0, 0 }
+};
+
+// Castling characters -> castling right, 0 for anything else
+const unsigned char fen_castle_codes[256] = { ['K'] = wk, ['Q'] = wq, ['k'] = bk, ['q'] = bq };
+
+// Castling right [wk, wq, bk, bq order] -> the king & rook (piece & square) it needs
+const int castle_rights[4] = { wk, wq, bk, bq };
+const int castle_pieces[4][2] = { { K, R }, { K, R }, { k, r }, { k, r } };
+const int castle_squares[4][2] = { { e1, h1 }, { e1, a1 }, { e8, h8 }, { e8, a8 } };
+
+// Most pseudo-legal moves of one piece [piece type] -> pawns promote with a push & 2 captures, kings castle both ways
+const int piece_most_moves[6] = { 12, 8, 13, 14, 27, 10 };
+
+// Longest FEN position_to_fen writes (64 pieces, 7 '/', " w KQkq e3 9999 9999") without the terminating zero
+#define FEN_MAX_LENGTH 91
+
+// The attack lookup (see Attacks) -> the check test needs it
+extern int (*is_square_attacked)(position *pos, int square, int side);
+
+// Give up on a malformed FEN -> leaves an empty board behind
+static int invalid_fen(position *pos, int error) {
+    reset_board(pos);
+    return error;
+}
+
+// Skip the spaces between two FEN fields -> NULL if there's no space or nothing after it
+static inline const char *next_fen_field(const char *fen, const char *end) {
+    if (fen >= end || *fen != ' ') {
+        return NULL;
+    }
+    while (fen < end && *fen == ' ') {
+        fen++;
+    }
+    return (fen < end) ? fen : NULL;
+}
 
-            // Match ascii pieces within FEN string
-            if ((*fen >= 'a' && *fen <= 'z') || (*fen >= 'A' && *fen <= 'Z')) {
-                // Set current piece type
-                int piece = char_pieces[*fen];
-                
-                // Set piece on corresponding bitboard
-                set_bit(bitboards[piece], square);
+// Parse a FEN counter (at most 4 digits) -> -1 if there's none
+static inline int parse_fen_counter(const char **fen, const char *end) {
+    int value = 0, digits = 0;
+    while (*fen < end && **fen >= '0' && **fen <= '9') {
+        if (++digits > 4) {
+            return -1;
+        }
+        value = value * 10 + (*(*fen)++ - '0');
+    }
+    return digits ? value : -1;
+}
 
-                // Increment the pointer in the FEN string (to get the next character)
-                *fen++;
-            } else if (*fen >= '0' && *fen <= '9') { // Match empty square numbers within FEN string (the integer values denoting empty squares between pieces on the rank)
-                // Calculate the offset -> Convert the character of 0 to the integer of 0 (getting number essentially)
-                int offset = *fen - '0';
+/*
+    Check a position's pieces, side to move, castling rights & en passant square against each other -> fen_ok or the
+    error. Castling rights without the king & rook on their starting squares get dropped rather than refused.
+    Shared by the FEN parser & unpack_position.
+*/
+int position_error(position *pos) {
+    // One king per side & no pawns on the 1st or 8th rank
+    if (count_bits(pos->bitboards[K]) != 1 || count_bits(pos->bitboards[k]) != 1) {
+        return fen_bad_kings;
+    }
+    if ((pos->bitboards[P] | pos->bitboards[p]) & 0xFF000000000000FFULL) {
+        return fen_bad_pawns;
+    }
 
-                // Adjust the file counter -> skips all the empty squares
-                file += offset - 1;
+    // Every piece beyond the starting set needs a pawn that promoted, which keeps the move lists within MAX_MOVES. Debug
+    // positions like the killer position (9 white pawns) break that rule, so material is only refused when the most moves
+    // its pieces could have also goes past MAX_MOVES.
+    for (int side = white; side <= black; side++) {
+        int first = (side == white) ? P : p;
+        int pawns = count_bits(pos->bitboards[first]);
+        int promoted = 0, most_moves = 0;
+        for (int piece = first; piece <= first + 5; piece++) {
+            int extra = count_bits(pos->bitboards[piece]) - ((piece >= first + 4) ? 1 : 2);
+            promoted += (piece != first && piece != first + 5 && extra > 0) ? extra : 0;
+            most_moves += count_bits(pos->bitboards[piece]) * piece_most_moves[piece - first];
+        }
+        if (pawns + promoted > 8 && most_moves > MAX_MOVES) {
+            return fen_bad_material;
+        }
+    }
 
-                // Increment the pointer in the FEN string (to get the next character)
-                *fen++;
-            } 
-            
+    // Drop the castling rights the pieces don't back up
+    for (int right = 0; right < 4; right++) {
+        if (!get_bit(pos->bitboards[castle_pieces[right][0]], castle_squares[right][0]) ||
+            !get_bit(pos->bitboards[castle_pieces[right][1]], castle_squares[right][1])) {
+            pos->castle &= ~castle_rights[right];
         }
-        if (*fen == '/')  { // Match rank separators
-            // Increment the pointer in the FEN string (to get the next character)
-            *fen++;
+    }
+
+    // En passant square -> empty, on the 6th rank with a black pawn in front of it (white to move) or on the 3rd with a
+    // white one
+    if (pos->enpassant != no_sq) {
+        int pawn_square = (pos->side == white) ? pos->enpassant + 8 : pos->enpassant - 8;
+        if ((pos->enpassant >> 3) != ((pos->side == white) ? 2 : 5) || get_bit(pos->occupancies[both], pos->enpassant) ||
+            !get_bit(pos->bitboards[(pos->side == white) ? p : P], pawn_square)) {
+            return fen_bad_enpassant;
         }
     }
 
-    // printf("fen: %s\n", fen);
-    // parse side to move
-    *fen++; // Move to side character
-    if (*fen == 'w') {
-        side = white;
-    } else if (*fen == 'b') {
-        side = black;
+    // The side to move can't be able to take the king
+    if (is_square_attacked(pos, get_ls1b_index(pos->bitboards[(pos->side == white) ? k : K]), pos->side)) {
+        return fen_king_capture;
+    }
+
+    return fen_ok;
+}
+
+// Parse a FEN (or EPD) string of the given length into a position -> fen_ok, or the error (& an empty board)
+int parse_fen_length(position *pos, const char *fen, int length) {
+    const char *end = fen + length;
+
+    // Skip leading spaces
+    while (fen < end && *fen == ' ') {
+        fen++;
+    }
+
+    // Piece placement -> a8 to h1, with everything the board keeps about the pieces filled in on the way. Piece letters,
+    // digits & rank separators come in no predictable order, so instead of branching on them every character goes through
+    // the same steps, masked by its kind, & the errors get collected on the way.
+    memset(pos->bitboards, 0, sizeof(pos->bitboards));
+    U64 hash_key = 0ULL, pawn_key = 0ULL;
+    int psq_score = 0, phase = 0;
+    int square = 0, file = 0, error = 0;
+    while (fen < end && *fen != ' ') {
+        const fen_code *code = &fen_board_codes[(unsigned char)*fen++];
+        int piece_mask = -(code->kind & FEN_PIECE);
+        int rank_mask = -((code->kind & FEN_RANK) >> 2);
+        int slot = square & 63;
+
+        // Place the piece
+        pos->bitboards[code->piece] |= (1ULL << slot) & (U64)(long long)piece_mask;
+        hash_key ^= piece_keys[code->piece][slot] & (U64)(long long)piece_mask;
+        pawn_key ^= piece_keys[code->piece][slot] & (U64)(long long)-code->pawn;
+        psq_score += piece_square_values[code->piece][slot] & piece_mask;
+        phase += phase_values[code->piece] & piece_mask;
+
+        // Move on -> a rank has to be full before the separator & can't run past the h-file
+        error |= (code->kind == 0) | (rank_mask & ((file != 8) | (square >= 64)));
+        file = (file & ~rank_mask) + code->squares;
+        square += code->squares;
+        error |= file > 8;
+    }
+    if (error || square != 64) {
+        return invalid_fen(pos, fen_bad_board);
+    }
+
+    // Occupancies
+    pos->occupancies[white] = pos->bitboards[P] | pos->bitboards[N] | pos->bitboards[B] |
+                              pos->bitboards[R] | pos->bitboards[Q] | pos->bitboards[K];
+    pos->occupancies[black] = pos->bitboards[p] | pos->bitboards[n] | pos->bitboards[b] |
+                              pos->bitboards[r] | pos->bitboards[q] | pos->bitboards[k];
+    pos->occupancies[both] = pos->occupancies[white] | pos->occupancies[black];
+
+    // Side to move
+    if ((fen = next_fen_field(fen, end)) == NULL || (*fen != 'w' && *fen != 'b')) {
+        return invalid_fen(pos, fen_bad_side);
     }
+    pos->side = (*fen++ == 'w') ? white : black;
 
-    // parse castling rights
-    fen += 2; // Move to castling rights character
-    while (*fen != ' ') {
-        switch (*fen) {
-            case 'K' : castle |= wk; break;
-            case 'Q' : castle |= wq; break;
-            case 'k' : castle |= bk; break;
-            case 'q' : castle |= bq; break;
-            case '-' : break;
+    // Castling rights
+    if ((fen = next_fen_field(fen, end)) == NULL) {
+        return invalid_fen(pos, fen_bad_castling);
+    }
+    pos->castle = 0;
+    if (*fen == '-') {
+        fen++;
+    } else {
+        while (fen < end && *fen != ' ') {
+            int right = fen_castle_codes[(unsigned char)*fen++];
+            if (!right || (pos->castle & right)) {
+                return invalid_fen(pos, fen_bad_castling);
+            }
+            pos->castle |= right;
         }
-        // Increment the pointer in the FEN string (to get the next character)
-        *fen++;
     }
 
-    // parse en passant square
-    // Increment the pointer in the FEN string (to get the en passant square)
-    *fen++;
-    
-    if (*fen != '-') {
-        // get file & rank
-        int file = fen[0] - 'a'; // convert file into integer
-        int rank = 8 - (fen[1] - '0'); // convert rank into integer
-        // set en passant square
-        enpassant = rank * 8 + file;
-
-        // Increment to get the half moves
-        fen += 3;
-    } else { // no en passant
-        enpassant = no_sq;
-
-        // Increment to get the half moves
+    // En passant square (checked against the pieces by position_error)
+    if ((fen = next_fen_field(fen, end)) == NULL) {
+        return invalid_fen(pos, fen_bad_enpassant);
+    }
+    pos->enpassant = no_sq;
+    if (*fen == '-') {
+        fen++;
+    } else {
+        if (fen + 1 >= end || fen[0] < 'a' || fen[0] > 'h' || fen[1] < '1' || fen[1] > '8') {
+            return invalid_fen(pos, fen_bad_enpassant);
+        }
+        pos->enpassant = (8 - (fen[1] - '0')) * 8 + (fen[0] - 'a');
         fen += 2;
     }
+    if (fen < end && *fen != ' ') {
+        return invalid_fen(pos, fen_bad_enpassant);
+    }
+
+    // Half & full move counters -> optional, as long as they're numbers
+    pos->half_moves = 0;
+    pos->full_moves = 1;
+    const char *counter = next_fen_field(fen, end);
+    if (counter != NULL && *counter >= '0' && *counter <= '9') {
+        if ((pos->half_moves = parse_fen_counter(&counter, end)) < 0) {
+            return invalid_fen(pos, fen_bad_counters);
+        }
+        fen = next_fen_field(counter, end);
+        if (fen != NULL && *fen >= '0' && *fen <= '9') {
+            if ((pos->full_moves = parse_fen_counter(&fen, end)) < 0) {
+                return invalid_fen(pos, fen_bad_counters);
+            }
+        }
+    }
 
-    // parse half moves (max two characters) & full moves
-    while (*fen != ' ') {
-        half_moves = half_moves * 10 + (*fen - '0'); // Add half moves with appropriate digit management.
-        // Increment pointer to move to next half move char or space
-        *fen++;
+    // Does the rest of the state fit the pieces?
+    error = position_error(pos);
+    if (error != fen_ok) {
+        return invalid_fen(pos, error);
     }
 
-    // parse full moves
-    *fen++; // Move pointer to first full move character
-    while (*fen != ' ') {
-        full_moves = full_moves * 10 + (*fen - '0'); // Add half moves with appropriate digit management.
-        // Increment pointer to move to next full move char or space
-        *fen++;
+    // Hash keys (the pieces are in already) & the incrementally updated evaluation terms
+    if (pos->enpassant != no_sq) {
+        hash_key ^= enpassant_keys[pos->enpassant];
     }
-    
+    hash_key ^= castle_keys[pos->castle];
+    if (pos->side == black) {
+        hash_key ^= side_key;
+    }
+    pos->hash_key = hash_key;
+    pos->pawn_key = pawn_key;
+    pos->psq_score = psq_score;
+    pos->phase = phase;
+    if (nnue_mode != nnue_off) {
+        nnue_refresh_accumulators(pos);
+    }
+
+    // Empty the undo stack
+    pos->undo_count = 0;
+
+    return fen_ok;
+}
 
+// Parse a null-terminated FEN string (see parse_fen_length)
+int parse_fen(position *pos, const char *fen) {
+    return parse_fen_length(pos, fen, (int)strlen(fen));
+}
+
+// Write a FEN counter
+static inline char *write_fen_counter(char *fen, int value) {
+    char digits[12];
+    int count = 0;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (count) {
+        *fen++ = digits[--count];
+    }
+    return fen;
+}
 
-    //// Initialize occupancy boards ////
+// Write a position as a FEN string into fen (room for size characters) -> the length of the FEN, or 0 if it doesn't fit.
+// The FEN never gets longer than FEN_MAX_LENGTH characters (+ the terminating zero).
+int position_to_fen(position *pos, char *fen, int size) {
+    // Piece letters by square
+    char board[64];
+    memset(board, 0, sizeof(board));
+    for (int piece = P; piece <= k; piece++) {
+        U64 bitboard = pos->bitboards[piece];
+        while (bitboard) {
+            int square = get_ls1b_index(bitboard);
+            board[square] = ascii_pieces[piece];
+            pop_bit(bitboard, square);
+        }
+    }
 
-    // Set white pieces bitboards
-    for (int piece = P; piece <= K; piece++) {
-        // populate white occupancy bitboards
-        occupancies[white] |= bitboards[piece];
+    // Piece placement
+    char buffer[FEN_MAX_LENGTH + 8];
+    char *out = buffer;
+    for (int square = 0; square < 64; square++) {
+        if (square && !(square & 7)) {
+            *out++ = '/';
+        }
+        if (board[square]) {
+            *out++ = board[square];
+        } else {
+            // Run of empty squares up to the end of the rank
+            int empty = 1;
+            while ((square & 7) != 7 && !board[square + 1]) {
+                square++;
+                empty++;
+            }
+            *out++ = '0' + empty;
+        }
     }
 
-    // Set black pieces bitboards
-    for (int piece = p; piece <= k; piece++) {
-        // populate black occupancy bitboards
-        occupancies[black] |= bitboards[piece];
+    // Side to move & castling rights
+    *out++ = ' ';
+    *out++ = (pos->side == white) ? 'w' : 'b';
+    *out++ = ' ';
+    if (!pos->castle) {
+        *out++ = '-';
+    }
+    if (pos->castle & wk) *out++ = 'K';
+    if (pos->castle & wq) *out++ = 'Q';
+    if (pos->castle & bk) *out++ = 'k';
+    if (pos->castle & bq) *out++ = 'q';
+
+    // En passant square
+    *out++ = ' ';
+    if (pos->enpassant != no_sq) {
+        *out++ = square_to_coordinates[pos->enpassant][0];
+        *out++ = square_to_coordinates[pos->enpassant][1];
+    } else {
+        *out++ = '-';
     }
 
-    // Set Both sides occupancies
-    occupancies[both] |= (occupancies[white] | occupancies[black]);
+    // Counters (clamped to 4 digits, like the parser takes them)
+    *out++ = ' ';
+    out = write_fen_counter(out, (pos->half_moves < 9999) ? pos->half_moves : 9999);
+    *out++ = ' ';
+    out = write_fen_counter(out, (pos->full_moves < 9999) ? pos->full_moves : 9999);
+
+    int length = (int)(out - buffer);
+    if (length + 1 > size) {
+        return 0;
+    }
+    memcpy(fen, buffer, length);
+    fen[length] = '\0';
+    return length;
 }
 
 /******************************************\
@@ -564,6 +1135,12 @@ const int rook_relevant_occ_bits[64] = {
     12,  11,  11,  11,  11,  11,  11,  12,
 };
 
+// Magic numbers found by the magic number search (see Magic Number Search) -> make magics writes new ones to magic_numbers.h,
+// building with -DGENERATED_MAGICS uses those instead of these
+#ifdef GENERATED_MAGICS
+    #include "magic_numbers.h"
+#else
+
 U64 rook_magic_numbers[64] = {
     0x8a80104000800020ULL,
     0x140002000100040ULL,
@@ -697,6 +1274,37 @@ U64 bishop_magic_numbers[64] = {
     0x4010011029020020ULL,
 };
 
+// Index bits of every magic number -> the same as the relevant occupancy bits for these ones (a search with "fewer"
+// can find magics that need less)
+#define rook_magic_bits rook_relevant_occ_bits
+#define bishop_magic_bits bishop_relevant_occ_bits
+
+#endif
+
+// Size of the fancy slider attacks table -> every bishop & rook sub-table back to back (generated magics bring their own)
+#ifndef SLIDER_TABLE_SIZE
+    #define SLIDER_TABLE_SIZE 107648
+#endif
+
+// Size of the PEXT slider table -> a slot for every relevant occupancy of every square
+#define PEXT_TABLE_SIZE 107648
+
+// Distinct slider attack sets over all squares -> 4900 for rooks & 1428 for bishops
+#define SLIDER_SET_COUNT 6328
+
+// Attack tables built ahead of time (see Attack Table Generator) -> pawn, knight & king attacks, masks, offsets & slider attacks
+#ifdef GENERATED_TABLES
+    #include "attack_tables.h"
+
+// The slider table is laid out by the magic numbers, so the header has to come from a generator built with the same ones
+#if defined(GENERATED_MAGICS) && !defined(ATTACK_TABLES_GENERATED_MAGICS)
+    #error "attack_tables.h was built with the default magic numbers -> regenerate it with -DGENERATED_MAGICS (make magics)"
+#elif !defined(GENERATED_MAGICS) && defined(ATTACK_TABLES_GENERATED_MAGICS)
+    #error "attack_tables.h was built with magic_numbers.h -> regenerate it without -DGENERATED_MAGICS (make tables)"
+#endif
+
+#else
+
 // Pawn Attacks Table -> [side][square] -> 2 sides to attack
 U64 pawn_attacks[2][64];
 
@@ -709,15 +1317,26 @@ U64 king_attacks[64];
 // Bishop Attacks masks
 U64 bishop_masks[64];
 
+// Squares strictly between two squares on the same rank, file or diagonal -> [from][to], empty if they don't share a line
+U64 between_squares[64][64];
+
+// The whole line (rank, file or diagonal) through two squares -> [from][to], empty if they don't share a line
+U64 line_squares[64][64];
+
 // Rook attack masks
 U64 rook_masks[64];
 
+// The plain tables below are ~2.3 MB & nothing looks them up anymore (the fancy slider table replaced them) -> only built with -DPLAIN_TABLES
+#ifdef PLAIN_TABLES
+
 // Bishop Attacks Table -> [square][occupancies] -> occupancies represent number of possible occupancies (blocking an attack). For Bishops, it's 512.
 U64 bishop_attacks[64][512];
 
 // Rook Attacks Table -> [square][occupancies]
 U64 rook_attacks[64][4096];
 
+#endif
+
 // Slider attacks table -> includes bishop & rook attacks; indexable using offset.
 //// Total number of occupancy boards (divined by summing them up; see below) is 107648, which will be the size of our fancy slider attack look up table.
 //// This is compared to the plain method (see above) which has bishop and rook attacks tables, which, in total, uses 294912 bitboards (which aren't all necessary).
@@ -729,10 +1348,20 @@ U64 rook_attacks[64][4096];
     }
     printf("Total occupancy boards: %d", sum);
 */
-U64 slider_attacks[107648];
+U64 slider_attacks[SLIDER_TABLE_SIZE];
 int rook_offset[64];
 int bishop_offset[64];
 
+#ifdef SHARED_SLIDER_TABLE
+
+// Shared-entry slider table (see build_shared_slider_table) -> slot references into the distinct attack sets
+unsigned short slider_references[SLIDER_TABLE_SIZE];
+U64 slider_attack_sets[SLIDER_SET_COUNT];
+
+#endif
+
+#endif
+
 
 // Generate Pawn Attacks -> what square the pawn is on; what side (colour) it is on
 U64 mask_pawn_attacks(int side, int square) {
@@ -1036,6 +1665,26 @@ U64 rook_attacks_on_the_fly(int square, U64 blockboard) {
     return attacks;
 }
 
+#ifndef GENERATED_TABLES
+
+// Initialize the between & line tables -> out of the empty board slider attacks of both squares
+void init_line_tables() {
+    for (int from = 0; from < 64; from++) {
+        for (int to = 0; to < 64; to++) {
+            between_squares[from][to] = line_squares[from][to] = 0ULL;
+            if (from == to) continue;
+
+            if (rook_attacks_on_the_fly(from, 0ULL) & (1ULL << to)) {
+                between_squares[from][to] = rook_attacks_on_the_fly(from, 1ULL << to) & rook_attacks_on_the_fly(to, 1ULL << from);
+                line_squares[from][to] = (rook_attacks_on_the_fly(from, 0ULL) & rook_attacks_on_the_fly(to, 0ULL)) | (1ULL << from) | (1ULL << to);
+            } else if (bishop_attacks_on_the_fly(from, 0ULL) & (1ULL << to)) {
+                between_squares[from][to] = bishop_attacks_on_the_fly(from, 1ULL << to) & bishop_attacks_on_the_fly(to, 1ULL << from);
+                line_squares[from][to] = (bishop_attacks_on_the_fly(from, 0ULL) & bishop_attacks_on_the_fly(to, 0ULL)) | (1ULL << from) | (1ULL << to);
+            }
+        }
+    }
+}
+
 // Initialize leaper pieces attacks
 void init_leapers_attacks() {
     // Loop over 64 board squares
@@ -1052,6 +1701,8 @@ void init_leapers_attacks() {
     }
 }
 
+#endif
+
 // Set Occupancies -> index, number of bits in the attack mask, and the attack mask itself
 // Basically, the occupancy bitboard holds all possible positions for the given attack mask to be blocked!
 // In other words, a 1 on the board simply means that there's a piece there (that will block the attack mask's piece from reaching the edges of the board)
@@ -1083,33 +1734,74 @@ U64 set_occupancy(int index, int bits_in_mask, U64 attack_mask) {
     return occupancy;
 }
 
-// Get our bishop attacks - Fancy
-static inline U64 get_bishop_attacks(int square, U64 occupancy) {
+// Slider attack backends -> magic numbers (works everywhere) or BMI2's pext instruction (see Slider Backends)
+enum { slider_magic, slider_pext };
+
+// PEXT slider table -> one sub-table per square & piece like the fancy table, but indexed by the occupancy bits under the
+// mask packed together (so no magic numbers are needed) -> part of attack_tables.h in -DGENERATED_TABLES builds
+#ifndef GENERATED_TABLES
+U64 pext_attacks[PEXT_TABLE_SIZE];
+int bishop_pext_offset[64];
+int rook_pext_offset[64];
+#endif
+
+// Parallel bit extract -> gathers the bits of source under mask into the low bits.
+// Straight from inline assembly, so the engine builds without -mbmi2 (it's only ever run once cpuid has said BMI2 is there).
+static inline U64 pext(U64 source, U64 mask) {
+#if defined(__x86_64__)
+    U64 result;
+    __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(source), "r"(mask));
+    return result;
+#else
+    U64 result = 0;
+    for (U64 bit = 1; mask; bit <<= 1, mask &= mask - 1) {
+        if (source & mask & -mask) result |= bit;
+    }
+    return result;
+#endif
+}
+
+// Get our bishop attacks - Fancy (or PEXT) -> the backend is always a constant at the call site, so the other one gets compiled out
+static inline U64 get_bishop_attacks(int square, U64 occupancy, int backend) {
+    // PEXT -> the relevant occupancy bits are the index
+    if (backend == slider_pext) return pext_attacks[bishop_pext_offset[square] + pext(occupancy, bishop_masks[square])];
+
     // Get bishop attacks assuming current board occupancy
     int offset = bishop_offset[square];
     occupancy &= bishop_masks[square];
     occupancy *= bishop_magic_numbers[square];
-    occupancy >>= 64 - bishop_relevant_occ_bits[square];
+    occupancy >>= 64 - bishop_magic_bits[square];
+#ifdef SHARED_SLIDER_TABLE
+    return slider_attack_sets[slider_references[offset + occupancy]];
+#else
     return slider_attacks[offset + occupancy];
+#endif
 }
 
-static inline U64 get_rook_attacks(int square, U64 occupancy) {
+static inline U64 get_rook_attacks(int square, U64 occupancy, int backend) {
+    // PEXT -> the relevant occupancy bits are the index
+    if (backend == slider_pext) return pext_attacks[rook_pext_offset[square] + pext(occupancy, rook_masks[square])];
+
     // Get rook attacks assuming current board occupancy
     int offset = rook_offset[square];
     occupancy &= rook_masks[square];
     occupancy *= rook_magic_numbers[square];
-    occupancy >>= 64 - rook_relevant_occ_bits[square];
+    occupancy >>= 64 - rook_magic_bits[square];
+#ifdef SHARED_SLIDER_TABLE
+    return slider_attack_sets[slider_references[offset + occupancy]];
+#else
     return slider_attacks[offset + occupancy];
+#endif
 }
 
 // Get Queen Attacks
-static inline U64 get_queen_attacks(int square, U64 occupancy) {
+static inline U64 get_queen_attacks(int square, U64 occupancy, int backend) {
     // Initialize result bitboard
     U64 queen_attacks;
 
     // Run through bishop and queen attacks, adding them to the queen attacks board.
-    queen_attacks = get_bishop_attacks(square, occupancy); // Add diagonal attacks
-    queen_attacks |= get_rook_attacks(square, occupancy); // Add horizontal and vertical attacks
+    queen_attacks = get_bishop_attacks(square, occupancy, backend); // Add diagonal attacks
+    queen_attacks |= get_rook_attacks(square, occupancy, backend); // Add horizontal and vertical attacks
     return queen_attacks;
 }
 
@@ -1126,8 +1818,16 @@ static inline U64 get_queen_attacks(int square, U64 occupancy) {
 
 
 
-// Find the appropriate magic number
-U64 find_magic_number(int square, int rel_occ_bits, int bishop_flag) {
+// Magic candidate random numbers (xorshift64*) -> the state gets passed in, so searching threads don't share any (see Magic Number Search)
+static inline U64 magic_random(U64 *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// Find a magic number for the square that indexes its attacks with magic_bits bits -> returns 0 if none shows up within tries candidates
+U64 find_magic_number(int square, int magic_bits, int bishop_flag, U64 *random_state, long long tries) {
 
     //// Initialize everything!!! //
 
@@ -1135,15 +1835,20 @@ U64 find_magic_number(int square, int rel_occ_bits, int bishop_flag) {
     U64 occupancies[4096];
 
     // Initialize attack tables
-    U64 attacks[4096]; 
+    U64 attacks[4096];
 
-    // Initialize used attacks
+    // Initialize used attacks -> a slot only counts as used if it was used by the current candidate (its epoch matches),
+    // so moving on to the next candidate is one increment instead of clearing 32 KB
     U64 used_attacks[4096];
+    unsigned int used_epoch[4096];
+    unsigned int epoch = 0;
+    memset(used_epoch, 0, sizeof(used_epoch));
 
     // Initialize attack mask for a current piece
     U64 attack_mask = bishop_flag ? mask_bishop_attacks(square) : mask_rook_attacks(square);
 
-    // Initialize Occupancy Indices
+    // Initialize Occupancy Indices -> one for every way the relevant occupancy bits can be set
+    int rel_occ_bits = count_bits(attack_mask);
     int occupancy_indices = 1 << rel_occ_bits;
 
     // Loop over occupancy indices -> Generate all possible occupancy boards for a given attack mask
@@ -1158,18 +1863,25 @@ U64 find_magic_number(int square, int rel_occ_bits, int bishop_flag) {
         attacks[index] = bishop_flag ? bishop_attacks_on_the_fly(square, occupancies[index]) : rook_attacks_on_the_fly(square, occupancies[index]);
     }
 
-    // Test magic numbers loop -> really high number to try and make sure that each occupancy index has their corresponding magic number
-    for (int random_count = 0; random_count < 100000000; random_count++) {
-        // Generate magic number candidate
-        U64 magic_number = generate_magic_number();
-
-        // If inappropriate magic number (I'm not sure what constitutes as inappropriate), then skip it
-        if (count_bits((attack_mask * magic_number) & 0xFF00000000000000) < 6) {
+    // Test magic numbers loop
+    for (long long random_count = 0; random_count < tries; random_count++) {
+        // Generate magic number candidate -> ones with few bits set work best for the full relevant bits, but the magics with
+        // fewer bits turn up among denser candidates (so those cycle through sparse, medium & dense ones)
+        U64 magic_number = magic_random(random_state);
+        int density = (magic_bits == rel_occ_bits) ? 0 : (int)(random_count % 3);
+        if (density < 2) magic_number &= magic_random(random_state);
+        if (density < 1) magic_number &= magic_random(random_state);
+
+        // Skip candidates that don't spread enough of the mask into the top byte (they hardly ever work at the full bits)
+        if (magic_bits == rel_occ_bits && count_bits((attack_mask * magic_number) & 0xFF00000000000000) < 6) {
             continue;
         }
 
-        // Initialize used attacks to 0
-        memset(used_attacks, 0ULL, sizeof(used_attacks));
+        // Next epoch -> forgets the used attacks of the last candidate (clear them for real when the counter wraps around)
+        if (++epoch == 0) {
+            memset(used_epoch, 0, sizeof(used_epoch));
+            epoch = 1;
+        }
 
         // Initialize index & fail flag (for failed magic number, which return a 0 for it instead of the number)
         int index, fail;
@@ -1177,65 +1889,35 @@ U64 find_magic_number(int square, int rel_occ_bits, int bishop_flag) {
         // test magic index loop -> looks over all possible occupancy indices (occupancy boards)
         for (index = 0, fail = 0; !fail && index < occupancy_indices; index++) {
             // Initialize magic index
-            //// occupancies (all possible occupancy boards for the given square & piece).
-            //// occupancies[index] = current occupancy board -> U64 bitboard
             //// Essentially, we multiply the magic number by the occupancy bitboard to spread bits across the 64-bit register in a pseudo-random way
-            // -> The right shift gets rid of irrelevant occupancy bits (keeps the index in the range of 0 to 2^(rel_occ_bits) - 1), keeping the topmost rel_occ_bits. rel_occ_bits is the number of bits required to index the attack table.
-            // Remember, for a square that has 4096 possible occupancy boards (associated with 4096 possible attacks), we need an index that could get us to the associated attack for each.
-            // This means we would need an index between 0 to 4095 (0 to 2^(rel_occ_bits) - 1), or rather, a 2^12 integer. By right shifting the amount of (64 - 12), we would get rid of all the other bits and only keep 12 bits for the index.
-            int magic_index = (int)((occupancies[index] * magic_number) >> (64 - rel_occ_bits));
+            // -> The right shift keeps the topmost magic_bits bits, which is the index into the square's attack table.
+            int magic_index = (int)((occupancies[index] * magic_number) >> (64 - magic_bits));
 
             //// Essentially, what the below does is ensure that every magic number is either:
             //// 1. Pointing to a full attack mask (given the current occupancy board) that only the magic_index points to
             //// 2. Pointing to a full attack mask that was already previously pointed to by another magic_index, but also is valid given the current occupancy board
             ///// (2 means that another attack mask exists there, but it'd still work as the proper possible attacks given the current occupancy board, so it's fine.)
-            // If the magic index works and the index isn't used
-            if (used_attacks[magic_index] == 0ULL) { // If the magic_index isn't pointing to a full attack mask (given the current occupancy board), then do so.
-                // Set used_attacks at the index to the attacks with the same index
+            if (used_epoch[magic_index] != epoch) {
+                // Unused slot -> take it
+                used_epoch[magic_index] = epoch;
                 used_attacks[magic_index] = attacks[index];
-            } else if (used_attacks[magic_index] != attacks[index]) { // If the magic index points to the incorrect possible attacks given the current occupancy board, then the magic number doesn't work.
-                // Magic index doesn't work
+            } else if (used_attacks[magic_index] != attacks[index]) {
+                // Slot already holds different attacks -> magic index doesn't work
                 fail = 1;
             }
-            // The above ensures that magic numbers will always generate magic indices that will never access an attack mask that isn't suitable for its associated occupancy board.
-            /// Multiple occupancy boards can access the same attack mask without issue, provided its one that's possible given the occupancies.
-
         }
+
         // If magic number works, return it
         if (!fail) {
             return magic_number;
         }
     }
-    // If magic number doesn't work
-    printf("    Magic number fails!");
+
+    // No magic number within the tries
     return 0ULL;
 }
 
-// Initialize Magic Numbers -> for testing purposes
-void initialize_magic_numbers() {
-    // Loop over 64 squares
-    for (int square = 0; square < 64; square++) {
-        // Initialize rook magic numbers
-        rook_magic_numbers[square] = find_magic_number(square, rook_relevant_occ_bits[square], rook);
-    }
-
-    // printf("\n\n");
-
-    for (int square = 0; square < 64; square++) {
-        // Initialize bishop magic numbers
-        bishop_magic_numbers[square] = find_magic_number(square, bishop_relevant_occ_bits[square], bishop);
-    }
-
-    // for (int square = 0; square < 64; square++) {
-    //     printf(" 0x%llxULL,\n", rook_magic_numbers[square]);
-    // }
-
-    // printf("\n\n");
-
-    // for (int square = 0; square < 64; square++) {
-    //     printf(" 0x%llxULL,\n", bishop_magic_numbers[square]);
-    // }
-}
+#ifndef GENERATED_TABLES
 
 // Initialize slider piece's attack tables using Fancy Magic Bitboards'
 
@@ -1254,8 +1936,9 @@ void init_slider_attacks(int bishop_flag) {
         // Get the attack mask for the current square & piece type
         U64 attack_mask = bishop_flag ? bishop_masks[square] : rook_masks[square];
 
-        // Grab relevant occupancy bit count
+        // Grab relevant occupancy bit count & the index bits of the square's magic number
         int rel_occ_bits = count_bits(attack_mask);
+        int magic_bits = bishop_flag ? bishop_magic_bits[square] : rook_magic_bits[square];
 
         // Initialize occupancy indices
         //// Occupancy indices is essentially the total number of combinations in which a piece can block the attacking rook/bishop from that square
@@ -1273,13 +1956,13 @@ void init_slider_attacks(int bishop_flag) {
             // Bishop
             if (bishop_flag) {
                 // Grab our magic index using the magic numbers
-                int magic_index = (int)((occupancy * bishop_magic_numbers[square]) >> (64 - rel_occ_bits));
+                int magic_index = (int)((occupancy * bishop_magic_numbers[square]) >> (64 - magic_bits));
 
                 // Use magic index to get our bishop attacks
                 slider_attacks[table_offset + magic_index] = bishop_attacks_on_the_fly(square, occupancy);
             } else { // Rook
                 // Grab our magic index using the magic numbers
-                int magic_index = (int)((occupancy * rook_magic_numbers[square]) >> (64 - rel_occ_bits));
+                int magic_index = (int)((occupancy * rook_magic_numbers[square]) >> (64 - magic_bits));
 
                 // Use magic index to get our rook attacks
                 slider_attacks[table_offset + magic_index] = rook_attacks_on_the_fly(square, occupancy);
@@ -1291,7 +1974,7 @@ void init_slider_attacks(int bishop_flag) {
         } else {
             rook_offset[square] = table_offset;
         }
-        table_offset = table_offset + occupancy_indices; // Update the offsets
+        table_offset = table_offset + (1 << magic_bits); // Update the offsets
         
     }
     // printf("hello world");
@@ -1300,6 +1983,8 @@ void init_slider_attacks(int bishop_flag) {
     }
 }
 
+#ifdef PLAIN_TABLES
+
 // Initialize slider piece's attack tables
 void init_slider_attacks_plain(int bishop_flag) {
     // Loop over 64 squares
@@ -1311,8 +1996,9 @@ void init_slider_attacks_plain(int bishop_flag) {
         // initialize current mask
         U64 attack_mask = bishop_flag ? bishop_masks[square] : rook_masks[square];
 
-        // Grab relevant occupancy bit count
+        // Grab relevant occupancy bit count & the index bits of the square's magic number
         int rel_occ_bits = count_bits(attack_mask);
+        int magic_bits = bishop_flag ? bishop_magic_bits[square] : rook_magic_bits[square];
 
         // Initialize occupancy indices
         int occupancy_indices = (1 << rel_occ_bits);
@@ -1324,13 +2010,13 @@ void init_slider_attacks_plain(int bishop_flag) {
             // Bishop
             if (bishop_flag) {
                 // Grab our magic index using the magic numbers
-                int magic_index = (int)((occupancy * bishop_magic_numbers[square]) >> (64 - rel_occ_bits));
+                int magic_index = (int)((occupancy * bishop_magic_numbers[square]) >> (64 - magic_bits));
 
                 // Use magic index to get our bishop attacks
                 bishop_attacks[square][magic_index] = bishop_attacks_on_the_fly(square, occupancy);
             } else { // Rook
                 // Grab our magic index using the magic numbers
-                int magic_index = (int)((occupancy * rook_magic_numbers[square]) >> (64 - rel_occ_bits));
+                int magic_index = (int)((occupancy * rook_magic_numbers[square]) >> (64 - magic_bits));
 
                 // Use magic index to get our rook attacks
                 rook_attacks[square][magic_index] = rook_attacks_on_the_fly(square, occupancy);
@@ -1340,30 +2026,6145 @@ void init_slider_attacks_plain(int bishop_flag) {
     
 }
 
-/******************************************\
-===========================================
+#endif
 
-            Initialize All
+#endif
 
-===========================================
-\******************************************/
+/*
+    Shared-entry slider table -> most of the 107648 slots hold the same attack set as plenty of others (a slider's attacks only
+    depend on the first blocker along each ray), & there are only 6328 different ones. So the shared layout stores every
+    distinct attack set once & each slot just holds a 16-bit reference to it: 210 KB of references + 50 KB of attack sets
+    instead of 841 KB, small enough to stay in L2, for one more (dependent) load per lookup.
+    Overlapping the sub-tables like "black magic" tables do doesn't save anything with our magics -> they hit every slot.
+
+    Building with -DSHARED_SLIDER_TABLE makes the engine look its slider attacks up this way.
+*/
+
+// Turn a back to back slider table into references & distinct attack sets -> returns the number of attack sets
+int build_shared_slider_table(const U64 *table, const int *bishop_offsets, const int *rook_offsets,
+                              unsigned short *references, U64 *attack_sets) {
+    int set_count = 0;
+
+    // Loop over every sub-table
+    for (int bishop_flag = 0; bishop_flag <= 1; bishop_flag++) {
+        for (int square = 0; square < 64; square++) {
+            int offset = bishop_flag ? bishop_offsets[square] : rook_offsets[square];
+            int occupancy_indices = 1 << (bishop_flag ? bishop_magic_bits[square] : rook_magic_bits[square]);
+
+            // Attack sets of this square start here -> other squares never share them
+            int first_set = set_count;
+
+            for (int slot = 0; slot < occupancy_indices; slot++) {
+                // Slots no occupancy maps to (magics with fewer bits than the mask can leave some) never get looked up
+                U64 attacks = table[offset + slot];
+                if (!attacks) {
+                    references[offset + slot] = 0;
+                    continue;
+                }
+
+                // Look for the attack set among this square's ones so far, add it if it's new
+                int set = first_set;
+                while (set < set_count && attack_sets[set] != attacks) set++;
+                if (set == set_count) attack_sets[set_count++] = attacks;
+
+                references[offset + slot] = (unsigned short)set;
+            }
+        }
+    }
+
+    return set_count;
+}
+
+/******************************************\
+===========================================
+
+        Attack Table Generator
+
+===========================================
+\******************************************/
+
+/*
+    The attack tables never change, so instead of building them on every start (which walks every occupancy subset of every
+    slider mask with the ray walkers) they can be built once & written out as a header:
+
+        make tables     -> builds genTables (this file with -DGENERATE_TABLES) & runs it to write attack_tables.h
+
+    Building with -DGENERATED_TABLES then includes that header, which defines all the tables as initialized const arrays:
+    they're ready in .rodata the moment the program is loaded, & since they're read-only file-backed pages, every running
+    engine process shares the same physical copy.
+*/
+
+#ifndef GENERATED_TABLES
+
+// Write a table of bitboards as a C initializer
+void write_bitboard_table(FILE *file, char *declaration, U64 *table, int size) {
+    fprintf(file, "const U64 %s = {", declaration);
+    for (int index = 0; index < size; index++) {
+        fprintf(file, "%s0x%llxULL,", (index % 4) ? " " : "\n    ", table[index]);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+// Write a 2-D table of bitboards as a C initializer -> one braced row per first index
+void write_bitboard_rows(FILE *file, char *declaration, U64 *table, int rows, int columns) {
+    fprintf(file, "const U64 %s = {", declaration);
+    for (int row = 0; row < rows; row++) {
+        fprintf(file, "\n    {");
+        for (int column = 0; column < columns; column++) {
+            fprintf(file, "%s0x%llxULL,", (column % 4) ? " " : "\n        ", table[row * columns + column]);
+        }
+        fprintf(file, "\n    },");
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+// Write a table of ints as a C initializer
+void write_int_table(FILE *file, char *declaration, int *table, int size) {
+    fprintf(file, "const int %s = {", declaration);
+    for (int index = 0; index < size; index++) {
+        fprintf(file, "%s%d,", (index % 8) ? " " : "\n    ", table[index]);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+// Write a table of 16-bit references as a C initializer
+void write_short_table(FILE *file, char *declaration, unsigned short *table, int size) {
+    fprintf(file, "const unsigned short %s = {", declaration);
+    for (int index = 0; index < size; index++) {
+        fprintf(file, "%s%d,", (index % 16) ? " " : "\n    ", table[index]);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+// Write all the (already initialized) attack tables as a header -> returns 0 on success
+int write_attack_tables(char *file_name) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        printf("Couldn't open %s for writing\n", file_name);
+        return 1;
+    }
+
+    fprintf(file, "// Attack tables for bbHighway.c -> generated by 'make tables' (or 'make magics'), don't edit by hand\n\n");
+#ifdef GENERATED_MAGICS
+    // Built with the magic numbers from magic_numbers.h -> the engine checks it's built with them too
+    fprintf(file, "#define ATTACK_TABLES_GENERATED_MAGICS\n\n");
+#endif
+    write_bitboard_rows(file, "pawn_attacks[2][64]", &pawn_attacks[0][0], 2, 64);
+    write_bitboard_table(file, "knight_attacks[64]", knight_attacks, 64);
+    write_bitboard_table(file, "king_attacks[64]", king_attacks, 64);
+    write_bitboard_table(file, "bishop_masks[64]", bishop_masks, 64);
+    write_bitboard_table(file, "rook_masks[64]", rook_masks, 64);
+    write_bitboard_rows(file, "between_squares[64][64]", &between_squares[0][0], 64, 64);
+    write_bitboard_rows(file, "line_squares[64][64]", &line_squares[0][0], 64, 64);
+    write_int_table(file, "bishop_offset[64]", bishop_offset, 64);
+    write_int_table(file, "rook_offset[64]", rook_offset, 64);
+
+    // The big tables take their sizes from the defines, so the header can't go out of step with them
+    char declaration[64];
+#ifdef SHARED_SLIDER_TABLE
+    snprintf(declaration, sizeof(declaration), "slider_references[%d]", SLIDER_TABLE_SIZE);
+    write_short_table(file, declaration, slider_references, SLIDER_TABLE_SIZE);
+    snprintf(declaration, sizeof(declaration), "slider_attack_sets[%d]", SLIDER_SET_COUNT);
+    write_bitboard_table(file, declaration, slider_attack_sets, SLIDER_SET_COUNT);
+#else
+    snprintf(declaration, sizeof(declaration), "slider_attacks[%d]", SLIDER_TABLE_SIZE);
+    write_bitboard_table(file, declaration, slider_attacks, SLIDER_TABLE_SIZE);
+#endif
+    snprintf(declaration, sizeof(declaration), "pext_attacks[%d]", PEXT_TABLE_SIZE);
+    write_bitboard_table(file, declaration, pext_attacks, PEXT_TABLE_SIZE);
+    write_int_table(file, "bishop_pext_offset[64]", bishop_pext_offset, 64);
+    write_int_table(file, "rook_pext_offset[64]", rook_pext_offset, 64);
+
+    fclose(file);
+    return 0;
+}
+
+#endif
+
+/******************************************\
+===========================================
+
+            Move Generator
+
+===========================================
+\******************************************/
+
+/*
+    Move encoding -> every move is packed into a single 32-bit integer (only the lower 24 bits are used)
+
+    binary move bits                                hexadecimal constants
+
+    0000 0000 0000 0000 0011 1111    source square       0x3f
+    0000 0000 0000 1111 1100 0000    target square       0xfc0
+    0000 0000 1111 0000 0000 0000    piece               0xf000
+    0000 1111 0000 0000 0000 0000    promoted piece      0xf0000
+    0001 0000 0000 0000 0000 0000    capture flag        0x100000
+    0010 0000 0000 0000 0000 0000    double push flag    0x200000
+    0100 0000 0000 0000 0000 0000    enpassant flag      0x400000
+    1000 0000 0000 0000 0000 0000    castling flag       0x800000
+
+    -> A promoted piece of 0 means "no promotion" (a pawn can never promote to a white pawn, so P doubles as the empty value)
+*/
+
+// Encode move macro
+#define encode_move(source, target, piece, promoted, capture, double_push, enpass, castling) \
+    (                           \
+        (source) |              \
+        ((target) << 6) |       \
+        ((piece) << 12) |       \
+        ((promoted) << 16) |    \
+        ((capture) << 20) |     \
+        ((double_push) << 21) | \
+        ((enpass) << 22) |      \
+        ((castling) << 23)      \
+    )
+
+// Extract move fields macros
+#define get_move_source(move) ((move) & 0x3f)
+#define get_move_target(move) (((move) & 0xfc0) >> 6)
+#define get_move_piece(move) (((move) & 0xf000) >> 12)
+#define get_move_promoted(move) (((move) & 0xf0000) >> 16)
+#define get_move_capture(move) ((move) & 0x100000)
+#define get_move_double(move) ((move) & 0x200000)
+#define get_move_enpassant(move) ((move) & 0x400000)
+#define get_move_castling(move) ((move) & 0x800000)
+
+// Move list structure -> lives on the stack of whoever calls generate_moves(), so move generation never touches the heap
+typedef struct {
+    // Packed moves
+    int moves[MAX_MOVES];
+
+    // Number of moves in the list
+    int count;
+} moves;
+
+// Promoted pieces -> used when printing moves in UCI format (promotions are always written in lowercase)
+char promoted_pieces[] = {
+    [Q] = 'q',
+    [R] = 'r',
+    [B] = 'b',
+    [N] = 'n',
+    [q] = 'q',
+    [r] = 'r',
+    [b] = 'b',
+    [n] = 'n'
+};
+
+// Add a move to the move list
+static inline void add_move(moves *move_list, int move) {
+    // Store the move & increment the move count
+    move_list->moves[move_list->count] = move;
+    move_list->count++;
+}
+
+// Write a move in UCI format (e.g. e2e4, e7e8q) into a string with room for 6 characters
+void move_to_string(int move, char *string) {
+    if (get_move_promoted(move)) {
+        sprintf(string, "%s%s%c", square_to_coordinates[get_move_source(move)],
+                                  square_to_coordinates[get_move_target(move)],
+                                  promoted_pieces[get_move_promoted(move)]);
+    } else {
+        sprintf(string, "%s%s", square_to_coordinates[get_move_source(move)],
+                                square_to_coordinates[get_move_target(move)]);
+    }
+}
+
+// Print a move in UCI format
+void print_move(int move) {
+    char string[6];
+    move_to_string(move, string);
+    printf("%s", string);
+}
+
+// Print the whole move list -> handy for debugging move generation
+void print_move_list(moves *move_list) {
+    // Don't print anything for an empty move list
+    if (!move_list->count) {
+        printf("\n    No moves in the move list!\n");
+        return;
+    }
+
+    printf("\n    move    piece   capture   double    enpass    castling\n\n");
+
+    // Loop over the moves within the move list
+    for (int move_count = 0; move_count < move_list->count; move_count++) {
+        // Grab the current move
+        int move = move_list->moves[move_count];
+
+        printf("    %s%s%c   %s       %d         %d         %d         %d\n",
+               square_to_coordinates[get_move_source(move)],
+               square_to_coordinates[get_move_target(move)],
+               get_move_promoted(move) ? promoted_pieces[get_move_promoted(move)] : ' ',
+               unicode_pieces[get_move_piece(move)],
+               get_move_capture(move) ? 1 : 0,
+               get_move_double(move) ? 1 : 0,
+               get_move_enpassant(move) ? 1 : 0,
+               get_move_castling(move) ? 1 : 0);
+    }
+
+    // Print the total number of moves
+    printf("\n\n    Total number of moves: %d\n\n", move_list->count);
+}
+
+// Is the given square attacked by the given side? -> Works backwards from the square: if a piece of the attacking side
+// sits on a square that a piece of the same type standing on the target square could reach, then that piece attacks the target square.
+// (Called through is_square_attacked, which points at the version for the selected slider backend.)
+static inline __attribute__((always_inline)) int is_square_attacked_backend(position *pos, int square, int side, int backend) {
+    // Attacked by white pawns -> look from the square with a *black* pawn's attack pattern (and vice versa)
+    if ((side == white) && (pawn_attacks[black][square] & pos->bitboards[P])) return 1;
+
+    // Attacked by black pawns
+    if ((side == black) && (pawn_attacks[white][square] & pos->bitboards[p])) return 1;
+
+    // Attacked by knights
+    if (knight_attacks[square] & ((side == white) ? pos->bitboards[N] : pos->bitboards[n])) return 1;
+
+    // Attacked by bishops
+    if (get_bishop_attacks(square, pos->occupancies[both], backend) & ((side == white) ? pos->bitboards[B] : pos->bitboards[b])) return 1;
+
+    // Attacked by rooks
+    if (get_rook_attacks(square, pos->occupancies[both], backend) & ((side == white) ? pos->bitboards[R] : pos->bitboards[r])) return 1;
+
+    // Attacked by queens
+    if (get_queen_attacks(square, pos->occupancies[both], backend) & ((side == white) ? pos->bitboards[Q] : pos->bitboards[q])) return 1;
+
+    // Attacked by kings
+    if (king_attacks[square] & ((side == white) ? pos->bitboards[K] : pos->bitboards[k])) return 1;
+
+    // The square isn't attacked
+    return 0;
+}
+
+// Every piece (of both sides) attacking the square, with the given occupancy blocking the sliders -> the pieces are taken
+// from the board, so pieces removed from the occupancy have to be masked out by the caller
+static inline U64 attackers_to(position *pos, int square, U64 occupancy, int backend) {
+    return (pawn_attacks[black][square] & pos->bitboards[P])
+         | (pawn_attacks[white][square] & pos->bitboards[p])
+         | (knight_attacks[square] & (pos->bitboards[N] | pos->bitboards[n]))
+         | (king_attacks[square] & (pos->bitboards[K] | pos->bitboards[k]))
+         | (get_bishop_attacks(square, occupancy, backend) & (pos->bitboards[B] | pos->bitboards[b] | pos->bitboards[Q] | pos->bitboards[q]))
+         | (get_rook_attacks(square, occupancy, backend) & (pos->bitboards[R] | pos->bitboards[r] | pos->bitboards[Q] | pos->bitboards[q]));
+}
+
+// Generate all pseudo-legal moves for the side to move -> moves that leave the own king in check are still included (make_move gets rid of those)
+// (Called through generate_moves, which points at the version for the selected slider backend.)
+static inline __attribute__((always_inline)) void generate_moves_backend(position *pos, moves *move_list, int backend) {
+    // Reset the move count
+    move_list->count = 0;
+
+    // Define source & target squares
+    int source_square, target_square;
+
+    // Define the current piece's bitboard copy & its attacks
+    U64 bitboard, attacks;
+
+    // Loop over all the piece bitboards
+    for (int piece = P; piece <= k; piece++) {
+        // Initialize the piece bitboard copy
+        bitboard = pos->bitboards[piece];
+
+        // Generate white pawn & white king castling moves
+        if (pos->side == white) {
+            // White pawns
+            if (piece == P) {
+                // Loop over the white pawns within the white pawn bitboard
+                while (bitboard) {
+                    // Initialize the source square
+                    source_square = get_ls1b_index(bitboard);
+
+                    // Initialize the target square (white pawns move "up" the board, towards a8)
+                    target_square = source_square - 8;
+
+                    // Generate quiet pawn moves -> target square has to be on the board & empty
+                    if (!(target_square < a8) && !get_bit(pos->occupancies[both], target_square)) {
+                        // Pawn promotion
+                        if (source_square >= a7 && source_square <= h7) {
+                            add_move(move_list, encode_move(source_square, target_square, piece, Q, 0, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, R, 0, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, B, 0, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, N, 0, 0, 0, 0));
+                        } else {
+                            // One square ahead pawn move
+                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+
+                            // Two squares ahead pawn move
+                            if ((source_square >= a2 && source_square <= h2) && !get_bit(pos->occupancies[both], target_square - 8)) {
+                                add_move(move_list, encode_move(source_square, target_square - 8, piece, 0, 0, 1, 0, 0));
+                            }
+                        }
+                    }
+
+                    // Initialize the pawn attacks bitboard
+                    attacks = pawn_attacks[pos->side][source_square] & pos->occupancies[black];
+
+                    // Generate pawn captures
+                    while (attacks) {
+                        // Initialize the target square
+                        target_square = get_ls1b_index(attacks);
+
+                        // Pawn capture promotion
+                        if (source_square >= a7 && source_square <= h7) {
+                            add_move(move_list, encode_move(source_square, target_square, piece, Q, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, R, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, B, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, N, 1, 0, 0, 0));
+                        } else {
+                            // Regular pawn capture
+                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                        }
+
+                        // Pop the LS1B of the pawn attacks
+                        pop_bit(attacks, target_square);
+                    }
+
+                    // Generate en passant captures
+                    if (pos->enpassant != no_sq) {
+                        // Look up pawn attacks & bitwise AND with the en passant square
+                        U64 enpassant_attacks = pawn_attacks[pos->side][source_square] & (1ULL << pos->enpassant);
+
+                        // Make sure that an en passant capture is available
+                        if (enpassant_attacks) {
+                            // Initialize the en passant capture target square
+                            int target_enpassant = get_ls1b_index(enpassant_attacks);
+                            add_move(move_list, encode_move(source_square, target_enpassant, piece, 0, 1, 0, 1, 0));
+                        }
+                    }
+
+                    // Pop the LS1B from the piece bitboard copy
+                    pop_bit(bitboard, source_square);
+                }
+            }
+
+            // White king castling moves
+            if (piece == K) {
+                // King side castling is available
+                if (pos->castle & wk) {
+                    // Make sure the squares between the king & the king's rook are empty
+                    if (!get_bit(pos->occupancies[both], f1) && !get_bit(pos->occupancies[both], g1)) {
+                        // Make sure the king & the f1 square aren't attacked (g1 gets checked by make_move like any other king move)
+                        if (!is_square_attacked_backend(pos, e1, black, backend) && !is_square_attacked_backend(pos, f1, black, backend)) {
+                            add_move(move_list, encode_move(e1, g1, piece, 0, 0, 0, 0, 1));
+                        }
+                    }
+                }
+
+                // Queen side castling is available
+                if (pos->castle & wq) {
+                    // Make sure the squares between the king & the queen's rook are empty
+                    if (!get_bit(pos->occupancies[both], d1) && !get_bit(pos->occupancies[both], c1) && !get_bit(pos->occupancies[both], b1)) {
+                        // Make sure the king & the d1 square aren't attacked
+                        if (!is_square_attacked_backend(pos, e1, black, backend) && !is_square_attacked_backend(pos, d1, black, backend)) {
+                            add_move(move_list, encode_move(e1, c1, piece, 0, 0, 0, 0, 1));
+                        }
+                    }
+                }
+            }
+        } else { // Generate black pawn & black king castling moves
+            // Black pawns
+            if (piece == p) {
+                // Loop over the black pawns within the black pawn bitboard
+                while (bitboard) {
+                    // Initialize the source square
+                    source_square = get_ls1b_index(bitboard);
+
+                    // Initialize the target square (black pawns move "down" the board, towards h1)
+                    target_square = source_square + 8;
+
+                    // Generate quiet pawn moves -> target square has to be on the board & empty
+                    if (!(target_square > h1) && !get_bit(pos->occupancies[both], target_square)) {
+                        // Pawn promotion
+                        if (source_square >= a2 && source_square <= h2) {
+                            add_move(move_list, encode_move(source_square, target_square, piece, q, 0, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, r, 0, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, b, 0, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, n, 0, 0, 0, 0));
+                        } else {
+                            // One square ahead pawn move
+                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+
+                            // Two squares ahead pawn move
+                            if ((source_square >= a7 && source_square <= h7) && !get_bit(pos->occupancies[both], target_square + 8)) {
+                                add_move(move_list, encode_move(source_square, target_square + 8, piece, 0, 0, 1, 0, 0));
+                            }
+                        }
+                    }
+
+                    // Initialize the pawn attacks bitboard
+                    attacks = pawn_attacks[pos->side][source_square] & pos->occupancies[white];
+
+                    // Generate pawn captures
+                    while (attacks) {
+                        // Initialize the target square
+                        target_square = get_ls1b_index(attacks);
+
+                        // Pawn capture promotion
+                        if (source_square >= a2 && source_square <= h2) {
+                            add_move(move_list, encode_move(source_square, target_square, piece, q, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, r, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, b, 1, 0, 0, 0));
+                            add_move(move_list, encode_move(source_square, target_square, piece, n, 1, 0, 0, 0));
+                        } else {
+                            // Regular pawn capture
+                            add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                        }
+
+                        // Pop the LS1B of the pawn attacks
+                        pop_bit(attacks, target_square);
+                    }
+
+                    // Generate en passant captures
+                    if (pos->enpassant != no_sq) {
+                        // Look up pawn attacks & bitwise AND with the en passant square
+                        U64 enpassant_attacks = pawn_attacks[pos->side][source_square] & (1ULL << pos->enpassant);
+
+                        // Make sure that an en passant capture is available
+                        if (enpassant_attacks) {
+                            // Initialize the en passant capture target square
+                            int target_enpassant = get_ls1b_index(enpassant_attacks);
+                            add_move(move_list, encode_move(source_square, target_enpassant, piece, 0, 1, 0, 1, 0));
+                        }
+                    }
+
+                    // Pop the LS1B from the piece bitboard copy
+                    pop_bit(bitboard, source_square);
+                }
+            }
+
+            // Black king castling moves
+            if (piece == k) {
+                // King side castling is available
+                if (pos->castle & bk) {
+                    // Make sure the squares between the king & the king's rook are empty
+                    if (!get_bit(pos->occupancies[both], f8) && !get_bit(pos->occupancies[both], g8)) {
+                        // Make sure the king & the f8 square aren't attacked
+                        if (!is_square_attacked_backend(pos, e8, white, backend) && !is_square_attacked_backend(pos, f8, white, backend)) {
+                            add_move(move_list, encode_move(e8, g8, piece, 0, 0, 0, 0, 1));
+                        }
+                    }
+                }
+
+                // Queen side castling is available
+                if (pos->castle & bq) {
+                    // Make sure the squares between the king & the queen's rook are empty
+                    if (!get_bit(pos->occupancies[both], d8) && !get_bit(pos->occupancies[both], c8) && !get_bit(pos->occupancies[both], b8)) {
+                        // Make sure the king & the d8 square aren't attacked
+                        if (!is_square_attacked_backend(pos, e8, white, backend) && !is_square_attacked_backend(pos, d8, white, backend)) {
+                            add_move(move_list, encode_move(e8, c8, piece, 0, 0, 0, 0, 1));
+                        }
+                    }
+                }
+            }
+        }
+
+        // Generate knight moves
+        if ((pos->side == white) ? piece == N : piece == n) {
+            // Loop over the source squares of the piece bitboard copy
+            while (bitboard) {
+                // Initialize the source square
+                source_square = get_ls1b_index(bitboard);
+
+                // Initialize the piece attacks -> can't land on our own pieces
+                attacks = knight_attacks[source_square] & ((pos->side == white) ? ~pos->occupancies[white] : ~pos->occupancies[black]);
+
+                // Loop over the target squares available from the generated attacks
+                while (attacks) {
+                    // Initialize the target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // Quiet move or capture?
+                    if (!get_bit(((pos->side == white) ? pos->occupancies[black] : pos->occupancies[white]), target_square)) {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                    } else {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                    }
+
+                    // Pop the LS1B in the current attacks set
+                    pop_bit(attacks, target_square);
+                }
+
+                // Pop the LS1B of the current piece bitboard copy
+                pop_bit(bitboard, source_square);
+            }
+        }
+
+        // Generate bishop moves
+        if ((pos->side == white) ? piece == B : piece == b) {
+            // Loop over the source squares of the piece bitboard copy
+            while (bitboard) {
+                // Initialize the source square
+                source_square = get_ls1b_index(bitboard);
+
+                // Initialize the piece attacks -> can't land on our own pieces
+                attacks = get_bishop_attacks(source_square, pos->occupancies[both], backend) & ((pos->side == white) ? ~pos->occupancies[white] : ~pos->occupancies[black]);
+
+                // Loop over the target squares available from the generated attacks
+                while (attacks) {
+                    // Initialize the target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // Quiet move or capture?
+                    if (!get_bit(((pos->side == white) ? pos->occupancies[black] : pos->occupancies[white]), target_square)) {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                    } else {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                    }
+
+                    // Pop the LS1B in the current attacks set
+                    pop_bit(attacks, target_square);
+                }
+
+                // Pop the LS1B of the current piece bitboard copy
+                pop_bit(bitboard, source_square);
+            }
+        }
+
+        // Generate rook moves
+        if ((pos->side == white) ? piece == R : piece == r) {
+            // Loop over the source squares of the piece bitboard copy
+            while (bitboard) {
+                // Initialize the source square
+                source_square = get_ls1b_index(bitboard);
+
+                // Initialize the piece attacks -> can't land on our own pieces
+                attacks = get_rook_attacks(source_square, pos->occupancies[both], backend) & ((pos->side == white) ? ~pos->occupancies[white] : ~pos->occupancies[black]);
+
+                // Loop over the target squares available from the generated attacks
+                while (attacks) {
+                    // Initialize the target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // Quiet move or capture?
+                    if (!get_bit(((pos->side == white) ? pos->occupancies[black] : pos->occupancies[white]), target_square)) {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                    } else {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                    }
+
+                    // Pop the LS1B in the current attacks set
+                    pop_bit(attacks, target_square);
+                }
+
+                // Pop the LS1B of the current piece bitboard copy
+                pop_bit(bitboard, source_square);
+            }
+        }
+
+        // Generate queen moves
+        if ((pos->side == white) ? piece == Q : piece == q) {
+            // Loop over the source squares of the piece bitboard copy
+            while (bitboard) {
+                // Initialize the source square
+                source_square = get_ls1b_index(bitboard);
+
+                // Initialize the piece attacks -> can't land on our own pieces
+                attacks = get_queen_attacks(source_square, pos->occupancies[both], backend) & ((pos->side == white) ? ~pos->occupancies[white] : ~pos->occupancies[black]);
+
+                // Loop over the target squares available from the generated attacks
+                while (attacks) {
+                    // Initialize the target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // Quiet move or capture?
+                    if (!get_bit(((pos->side == white) ? pos->occupancies[black] : pos->occupancies[white]), target_square)) {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                    } else {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                    }
+
+                    // Pop the LS1B in the current attacks set
+                    pop_bit(attacks, target_square);
+                }
+
+                // Pop the LS1B of the current piece bitboard copy
+                pop_bit(bitboard, source_square);
+            }
+        }
+
+        // Generate king moves
+        if ((pos->side == white) ? piece == K : piece == k) {
+            // Loop over the source squares of the piece bitboard copy
+            while (bitboard) {
+                // Initialize the source square
+                source_square = get_ls1b_index(bitboard);
+
+                // Initialize the piece attacks -> can't land on our own pieces
+                attacks = king_attacks[source_square] & ((pos->side == white) ? ~pos->occupancies[white] : ~pos->occupancies[black]);
+
+                // Loop over the target squares available from the generated attacks
+                while (attacks) {
+                    // Initialize the target square
+                    target_square = get_ls1b_index(attacks);
+
+                    // Quiet move or capture?
+                    if (!get_bit(((pos->side == white) ? pos->occupancies[black] : pos->occupancies[white]), target_square)) {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+                    } else {
+                        add_move(move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+                    }
+
+                    // Pop the LS1B in the current attacks set
+                    pop_bit(attacks, target_square);
+                }
+
+                // Pop the LS1B of the current piece bitboard copy
+                pop_bit(bitboard, source_square);
+            }
+        }
+    }
+}
+
+/******************************************\
+===========================================
+
+          Transposition Table
+
+===========================================
+\******************************************/
+
+/*
+    Transposition table -> shared by all the search threads, sized at run time.
+
+    The table is an array of 64-byte (cache line sized & aligned) buckets, each holding 4 entries of 16 bytes. A probe only ever
+    touches one bucket, so it costs at most one cache miss, and search prefetches the bucket as soon as make_move knows the
+    child's hash key.
+
+    Entry layout -> two 64-bit words: the data word & the hash key XORed with the data word.
+
+    data bits                                                                    meaning
+
+    0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 1111 1111 1111 1111 1111 1111    move (24 bits)
+    0000 0000 0000 0000 0000 0000 1111 1111 1111 1111 0000 0000 0000 0000 0000 0000    score (16 bits, stored + 32768)
+    0000 0000 0000 0000 1111 1111 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000    depth (8 bits)
+    0000 0000 0000 0011 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000    bound (2 bits)
+    0000 0000 1111 1100 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000    age (6 bits)
+
+    Lockless scheme -> threads read & write entries without any locks. If two threads write the same entry at the same time,
+    its two words can end up coming from different writes, but then key ^ data no longer gives back the hash key & the
+    probe simply misses. A reader can't be fooled by a half written entry either, for the same reason.
+*/
+
+// Scores -> mate scores are MATE_VALUE - ply (mating) or -MATE_VALUE + ply (getting mated)
+// Every score (INF included) has to fit the signed 16 bit score field of a TT entry -> keep them within +-32767
+#define INF 32000
+#define MATE_VALUE 31000
+#define MATE_SCORE 30000
+
+// Maximum search depth (in plies)
+#define MAX_PLY 64
+
+// Number of entries in a bucket
+#define TT_BUCKET_SIZE 4
+
+// Bound types -> exact score, upper bound (failed low / alpha) & lower bound (failed high / beta)
+enum { bound_none, bound_upper, bound_lower, bound_exact };
+
+// Pack & unpack the data word -> every field is masked to its width first, so one field can't spill into the next
+#define tt_pack(move, score, depth, bound, age)                 \
+    (                                                           \
+        (U64)((move) & 0xffffff) |                              \
+        ((U64)(unsigned short)((score) + 32768) << 24) |        \
+        ((U64)((depth) & 0xff) << 40) |                         \
+        ((U64)((bound) & 0x3) << 48) |                          \
+        ((U64)((age) & 0x3f) << 50)                             \
+    )
+
+#define tt_data_move(data) ((int)((data) & 0xffffff))
+#define tt_data_score(data) ((int)(((data) >> 24) & 0xffff) - 32768)
+#define tt_data_depth(data) ((int)(((data) >> 40) & 0xff))
+#define tt_data_bound(data) ((int)(((data) >> 48) & 0x3))
+#define tt_data_age(data) ((int)(((data) >> 50) & 0x3f))
+
+// Transposition table entry -> 16 bytes
+typedef struct {
+    U64 key; // hash key ^ data
+    U64 data;
+} tt_entry;
+
+// Transposition table bucket -> one cache line
+typedef struct __attribute__((aligned(CACHE_LINE_SIZE))) {
+    tt_entry entries[TT_BUCKET_SIZE];
+} tt_bucket;
+
+// Transposition table, its bucket index mask (the number of buckets is always a power of 2) & the current search age
+tt_bucket *tt_table = NULL;
+U64 tt_mask;
+int tt_age;
+
+// Allocate the transposition table -> uses the largest power of 2 number of buckets that fits in the given size
+void tt_init(int megabytes) {
+    // Free the previous table
+    aligned_free(tt_table);
+    tt_table = NULL;
+
+    // Round the number of buckets down to a power of 2 (at least one bucket)
+    U64 buckets = 1;
+    while (buckets * 2 * sizeof(tt_bucket) <= (U64)megabytes * 1024 * 1024) {
+        buckets *= 2;
+    }
+
+    // Allocate the table (aligned_calloc zeroes it)
+    tt_table = aligned_calloc(buckets, sizeof(tt_bucket));
+    if (tt_table == NULL) {
+        printf("    Couldn't allocate a %d MB transposition table\n", megabytes);
+        return;
+    }
+    tt_mask = buckets - 1;
+    tt_age = 0;
+}
+
+// Clear the transposition table
+void tt_clear() {
+    if (tt_table != NULL) {
+        memset(tt_table, 0, (tt_mask + 1) * sizeof(tt_bucket));
+    }
+    tt_age = 0;
+}
+
+// Start a new search -> entries from older searches become the first ones to get replaced
+void tt_new_search() {
+    tt_age = (tt_age + 1) & 0x3f;
+}
+
+// Prefetch the bucket of the given hash key
+static inline void tt_prefetch(U64 key) {
+    if (tt_table != NULL) {
+        __builtin_prefetch(&tt_table[key & tt_mask]);
+    }
+}
+
+// Mate scores are stored relative to the node (not the root), so they stay correct wherever the position shows up again
+static inline int tt_score_to(int score, int ply) {
+    if (score > MATE_SCORE) return score + ply;
+    if (score < -MATE_SCORE) return score - ply;
+    return score;
+}
+
+static inline int tt_score_from(int score, int ply) {
+    if (score > MATE_SCORE) return score - ply;
+    if (score < -MATE_SCORE) return score + ply;
+    return score;
+}
+
+// Probe the transposition table -> returns 1 & fills in the entry's fields if the position is in the table
+static inline int tt_probe(U64 key, int ply, int *move, int *score, int *depth, int *bound) {
+    if (tt_table == NULL) {
+        return 0;
+    }
+
+    // Look through the bucket
+    tt_bucket *bucket = &tt_table[key & tt_mask];
+    for (int index = 0; index < TT_BUCKET_SIZE; index++) {
+        // Read the data word once, so the check & the fields come from the same write
+        U64 data = bucket->entries[index].data;
+        if ((bucket->entries[index].key ^ data) == key && data) {
+            *move = tt_data_move(data);
+            *score = tt_score_from(tt_data_score(data), ply);
+            *depth = tt_data_depth(data);
+            *bound = tt_data_bound(data);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Store a search result in the transposition table
+static inline void tt_store(U64 key, int ply, int move, int score, int depth, int bound) {
+    if (tt_table == NULL) {
+        return;
+    }
+
+    // Pick the entry to replace
+    tt_bucket *bucket = &tt_table[key & tt_mask];
+    tt_entry *replace = &bucket->entries[0];
+    int lowest_worth = INF;
+
+    for (int index = 0; index < TT_BUCKET_SIZE; index++) {
+        tt_entry *entry = &bucket->entries[index];
+        U64 data = entry->data;
+
+        // Same position -> overwrite it, unless we'd lose a deeper result from this search
+        if ((entry->key ^ data) == key && data) {
+            if (bound != bound_exact && depth + 2 < tt_data_depth(data) && tt_data_age(data) == tt_age) {
+                return;
+            }
+
+            // Keep the old move if we don't have one
+            if (!move) {
+                move = tt_data_move(data);
+            }
+            replace = entry;
+            break;
+        }
+
+        // Otherwise replace the least worthy entry -> shallow & from old searches (empty entries are always the least worthy)
+        int worth = data ? tt_data_depth(data) - 8 * ((tt_age - tt_data_age(data)) & 0x3f) : -INF;
+        if (worth < lowest_worth) {
+            lowest_worth = worth;
+            replace = entry;
+        }
+    }
+
+    // Write the entry (key ^ data, see above)
+    U64 data = tt_pack(move, tt_score_to(score, ply), depth, bound, tt_age);
+    replace->key = key ^ data;
+    replace->data = data;
+}
+
+// Table usage in permill (sampled over the first 1000 buckets) -> for UCI's hashfull
+int tt_hashfull() {
+    if (tt_table == NULL) {
+        return 0;
+    }
+
+    int used = 0, total = 0;
+    for (U64 bucket = 0; bucket <= tt_mask && bucket < 1000; bucket++) {
+        for (int index = 0; index < TT_BUCKET_SIZE; index++) {
+            U64 data = tt_table[bucket].entries[index].data;
+            used += (data && tt_data_age(data) == tt_age);
+            total++;
+        }
+    }
+
+    return used * 1000 / total;
+}
+
+// Scores have to fit the signed 16 bit score field (mate scores move away from zero by up to MAX_PLY in tt_score_to)
+_Static_assert(INF + MAX_PLY <= 32767, "scores don't fit the 16 bit TT score field");
+
+// Pack & unpack test -> extreme scores with extreme neighbouring fields must all come back unchanged
+int tt_pack_test() {
+    int scores[] = { 0, 1, -1, MATE_SCORE + 1, -MATE_SCORE - 1, MATE_VALUE, -MATE_VALUE, MATE_VALUE - 1, -MATE_VALUE + 1,
+                     INF, -INF, 32767, -32768 };
+    int depths[] = { 0, 1, MAX_PLY, 255 };
+    int failures = 0, checks = 0;
+
+    printf("\n    TT pack & unpack test\n\n");
+
+    for (int score = 0; score < (int)(sizeof(scores) / sizeof(scores[0])); score++) {
+        for (int depth = 0; depth < (int)(sizeof(depths) / sizeof(depths[0])); depth++) {
+            for (int bound = bound_none; bound <= bound_exact; bound++) {
+                for (int age = 0; age < 64; age += 63) {
+                    for (int move = 0; move <= 0xffffff; move += 0xffffff) {
+                        U64 data = tt_pack(move, scores[score], depths[depth], bound, age);
+                        checks++;
+                        if (tt_data_move(data) != move || tt_data_score(data) != scores[score] ||
+                            tt_data_depth(data) != depths[depth] || tt_data_bound(data) != bound || tt_data_age(data) != age) {
+                            if (!failures++) {
+                                printf("    Mismatch: score %d depth %d bound %d age %d -> score %d depth %d bound %d age %d\n",
+                                       scores[score], depths[depth], bound, age, tt_data_score(data), tt_data_depth(data),
+                                       tt_data_bound(data), tt_data_age(data));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Mate scores through tt_score_to & tt_score_from at the deepest ply
+    for (int score = 0; score < (int)(sizeof(scores) / sizeof(scores[0])); score++) {
+        if (abs(scores[score]) > MATE_VALUE) continue;
+        U64 data = tt_pack(0, tt_score_to(scores[score], MAX_PLY - 1), 0, bound_exact, 0);
+        checks++;
+        if (tt_score_from(tt_data_score(data), MAX_PLY - 1) != scores[score]) {
+            if (!failures++) printf("    Mismatch: score %d through ply %d\n", scores[score], MAX_PLY - 1);
+        }
+    }
+
+    printf("    %s (%d checks, %d failures)\n\n", failures ? "FAIL" : "PASS", checks, failures);
+    return failures;
+}
+
+/******************************************\
+===========================================
+
+                  NNUE
+
+===========================================
+\******************************************/
+
+/*
+    Efficiently updatable neural network evaluation (HalfKP 40960 -> 2 x 256 -> 32 -> 32 -> 1)
+
+    -> Inputs: for each side's point of view ("perspective"), one feature per (own king square, non-king piece, square),
+       with the board mirrored (a8 <-> a1) for black so both perspectives see their own pieces moving up the board.
+    -> First layer: a 256 wide int16 accumulator per perspective = biases + the weight rows of its active features.
+       It lives in the position & make_move/take_back keep it up to date by adding & subtracting the rows of the pieces
+       a move moves, captures or promotes. Only a king move changes every feature of its own perspective -> refresh.
+    -> The rest runs at every evaluation: both accumulators (side to move first) clipped to 0..127 (uint8), then two
+       int8 x uint8 -> int32 layers of 32 (>> 6, clipped again) & a 32 -> 1 output divided by 16 -> centipawns.
+
+    The accumulator updates & the layers come in AVX2, SSE4.1 & scalar versions (all bit-for-bit the same), the best one
+    the CPU has gets picked at startup. The network gets loaded from a file (UCI option EvalFile, see nnue_load for the
+    layout); without one the engine keeps the hand-written evaluation.
+*/
+
+// Layer sizes
+#define NNUE_PIECE_SQUARES 640                      // 10 non-king pieces x 64 squares
+#define NNUE_INPUTS (64 * NNUE_PIECE_SQUARES)       // x 64 own king squares
+#define NNUE_L1 32
+#define NNUE_L2 32
+
+// Quantization -> layer outputs get shifted down before clipping, the output gets divided down to centipawns
+#define NNUE_SHIFT 6
+#define NNUE_OUTPUT_SCALE 16
+
+// Network file magic ("BBHN") & version
+#define NNUE_MAGIC 0x4e484242
+#define NNUE_VERSION 1
+
+// Network weights -> rows are cache line aligned, so the SIMD kernels can use aligned loads
+typedef struct {
+    short feature_biases[NNUE_HIDDEN] __attribute__((aligned(CACHE_LINE_SIZE)));
+    int l1_biases[NNUE_L1];
+    int l2_biases[NNUE_L2];
+    int output_bias;
+    signed char l1_weights[NNUE_L1][2 * NNUE_HIDDEN] __attribute__((aligned(CACHE_LINE_SIZE)));
+    signed char l2_weights[NNUE_L2][NNUE_L1] __attribute__((aligned(CACHE_LINE_SIZE)));
+    signed char output_weights[NNUE_L2] __attribute__((aligned(CACHE_LINE_SIZE)));
+    short feature_weights[NNUE_INPUTS][NNUE_HIDDEN] __attribute__((aligned(CACHE_LINE_SIZE)));
+} nnue_network;
+
+// The loaded network (NULL until one gets loaded)
+nnue_network *nnue = NULL;
+
+// Feature index of a piece on a square from a perspective
+static inline int nnue_feature(int view, int king_square, int piece, int square) {
+    // Black sees the board mirrored (a8 <-> a1)
+    if (view == black) {
+        king_square ^= 56;
+        square ^= 56;
+    }
+
+    // Piece type & whether it's one of the perspective's own pieces
+    int type = (piece >= p) ? piece - p : piece;
+    int theirs = (piece >= p) != (view == black);
+
+    return king_square * NNUE_PIECE_SQUARES + (type * 2 + theirs) * 64 + square;
+}
+
+// Accumulator update -> add & subtract weight rows
+void nnue_update_rows_scalar(short *accumulator, const short **added, int added_count, const short **removed, int removed_count) {
+    for (int index = 0; index < NNUE_HIDDEN; index++) {
+        int value = accumulator[index];
+        for (int row = 0; row < added_count; row++) value += added[row][index];
+        for (int row = 0; row < removed_count; row++) value -= removed[row][index];
+        accumulator[index] = (short)value;
+    }
+}
+
+// Clip an int32 layer output to 0..127
+static inline unsigned char nnue_clip(int value) {
+    value >>= NNUE_SHIFT;
+    return (unsigned char)((value < 0) ? 0 : ((value > 127) ? 127 : value));
+}
+
+// Layers after the accumulators -> returns the output in centipawns
+int nnue_propagate_scalar(const short *us, const short *them) {
+    // Clipped accumulators, side to move first
+    unsigned char input[2 * NNUE_HIDDEN];
+    for (int index = 0; index < NNUE_HIDDEN; index++) {
+        input[index] = (unsigned char)((us[index] < 0) ? 0 : ((us[index] > 127) ? 127 : us[index]));
+        input[NNUE_HIDDEN + index] = (unsigned char)((them[index] < 0) ? 0 : ((them[index] > 127) ? 127 : them[index]));
+    }
+
+    // Hidden layers
+    unsigned char hidden_1[NNUE_L1], hidden_2[NNUE_L2];
+    for (int neuron = 0; neuron < NNUE_L1; neuron++) {
+        int sum = nnue->l1_biases[neuron];
+        for (int index = 0; index < 2 * NNUE_HIDDEN; index++) sum += input[index] * nnue->l1_weights[neuron][index];
+        hidden_1[neuron] = nnue_clip(sum);
+    }
+    for (int neuron = 0; neuron < NNUE_L2; neuron++) {
+        int sum = nnue->l2_biases[neuron];
+        for (int index = 0; index < NNUE_L1; index++) sum += hidden_1[index] * nnue->l2_weights[neuron][index];
+        hidden_2[neuron] = nnue_clip(sum);
+    }
+
+    // Output
+    int output = nnue->output_bias;
+    for (int index = 0; index < NNUE_L2; index++) output += hidden_2[index] * nnue->output_weights[index];
+
+    return output / NNUE_OUTPUT_SCALE;
+}
+
+#if defined(__x86_64__)
+
+// Accumulator update, 8 values per instruction
+__attribute__((target("sse4.1"))) void nnue_update_rows_sse41(short *accumulator, const short **added, int added_count,
+                                                               const short **removed, int removed_count) {
+    for (int index = 0; index < NNUE_HIDDEN; index += 8) {
+        __m128i value = _mm_load_si128((const __m128i *)&accumulator[index]);
+        for (int row = 0; row < added_count; row++) value = _mm_add_epi16(value, _mm_load_si128((const __m128i *)&added[row][index]));
+        for (int row = 0; row < removed_count; row++) value = _mm_sub_epi16(value, _mm_load_si128((const __m128i *)&removed[row][index]));
+        _mm_store_si128((__m128i *)&accumulator[index], value);
+    }
+}
+
+// Sum of the 4 int32 lanes
+__attribute__((target("sse4.1"))) static inline int nnue_sum_sse41(__m128i sum) {
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// uint8 x int8 dot product, 16 pairs per instruction
+__attribute__((target("sse4.1"))) static inline int nnue_dot_sse41(const unsigned char *input, const signed char *weights, int count) {
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    for (int index = 0; index < count; index += 16) {
+        __m128i product = _mm_maddubs_epi16(_mm_load_si128((const __m128i *)&input[index]), _mm_load_si128((const __m128i *)&weights[index]));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(product, ones));
+    }
+    return nnue_sum_sse41(sum);
+}
+
+// Layers after the accumulators, 16 inputs per instruction
+__attribute__((target("sse4.1"))) int nnue_propagate_sse41(const short *us, const short *them) {
+    // Clipped accumulators -> packs saturates to -128..127, max cuts off the negatives
+    unsigned char input[2 * NNUE_HIDDEN] __attribute__((aligned(16)));
+    const short *halves[2] = { us, them };
+    for (int half = 0; half < 2; half++) {
+        for (int index = 0; index < NNUE_HIDDEN; index += 16) {
+            __m128i packed = _mm_packs_epi16(_mm_load_si128((const __m128i *)&halves[half][index]),
+                                             _mm_load_si128((const __m128i *)&halves[half][index + 8]));
+            _mm_store_si128((__m128i *)&input[half * NNUE_HIDDEN + index], _mm_max_epi8(packed, _mm_setzero_si128()));
+        }
+    }
+
+    // Hidden layers
+    unsigned char hidden_1[NNUE_L1] __attribute__((aligned(16))), hidden_2[NNUE_L2] __attribute__((aligned(16)));
+    for (int neuron = 0; neuron < NNUE_L1; neuron++) {
+        hidden_1[neuron] = nnue_clip(nnue->l1_biases[neuron] + nnue_dot_sse41(input, nnue->l1_weights[neuron], 2 * NNUE_HIDDEN));
+    }
+    for (int neuron = 0; neuron < NNUE_L2; neuron++) {
+        hidden_2[neuron] = nnue_clip(nnue->l2_biases[neuron] + nnue_dot_sse41(hidden_1, nnue->l2_weights[neuron], NNUE_L1));
+    }
+
+    // Output
+    return (nnue->output_bias + nnue_dot_sse41(hidden_2, nnue->output_weights, NNUE_L2)) / NNUE_OUTPUT_SCALE;
+}
+
+// Accumulator update, 16 values per instruction
+__attribute__((target("avx2"))) void nnue_update_rows_avx2(short *accumulator, const short **added, int added_count,
+                                                            const short **removed, int removed_count) {
+    for (int index = 0; index < NNUE_HIDDEN; index += 16) {
+        __m256i value = _mm256_load_si256((const __m256i *)&accumulator[index]);
+        for (int row = 0; row < added_count; row++) value = _mm256_add_epi16(value, _mm256_load_si256((const __m256i *)&added[row][index]));
+        for (int row = 0; row < removed_count; row++) value = _mm256_sub_epi16(value, _mm256_load_si256((const __m256i *)&removed[row][index]));
+        _mm256_store_si256((__m256i *)&accumulator[index], value);
+    }
+}
+
+// uint8 x int8 dot product, 32 pairs per instruction
+__attribute__((target("avx2"))) static inline int nnue_dot_avx2(const unsigned char *input, const signed char *weights, int count) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int index = 0; index < count; index += 32) {
+        __m256i product = _mm256_maddubs_epi16(_mm256_load_si256((const __m256i *)&input[index]), _mm256_load_si256((const __m256i *)&weights[index]));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(product, ones));
+    }
+    return nnue_sum_sse41(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+}
+
+// Layers after the accumulators, 32 inputs per instruction
+__attribute__((target("avx2"))) int nnue_propagate_avx2(const short *us, const short *them) {
+    // Clipped accumulators -> packs works per 128-bit lane, so the permute puts the 64-bit quarters back in order
+    unsigned char input[2 * NNUE_HIDDEN] __attribute__((aligned(32)));
+    const short *halves[2] = { us, them };
+    for (int half = 0; half < 2; half++) {
+        for (int index = 0; index < NNUE_HIDDEN; index += 32) {
+            __m256i packed = _mm256_packs_epi16(_mm256_load_si256((const __m256i *)&halves[half][index]),
+                                                _mm256_load_si256((const __m256i *)&halves[half][index + 16]));
+            packed = _mm256_permute4x64_epi64(_mm256_max_epi8(packed, _mm256_setzero_si256()), 0xd8);
+            _mm256_store_si256((__m256i *)&input[half * NNUE_HIDDEN + index], packed);
+        }
+    }
+
+    // Hidden layers
+    unsigned char hidden_1[NNUE_L1] __attribute__((aligned(32))), hidden_2[NNUE_L2] __attribute__((aligned(32)));
+    for (int neuron = 0; neuron < NNUE_L1; neuron++) {
+        hidden_1[neuron] = nnue_clip(nnue->l1_biases[neuron] + nnue_dot_avx2(input, nnue->l1_weights[neuron], 2 * NNUE_HIDDEN));
+    }
+    for (int neuron = 0; neuron < NNUE_L2; neuron++) {
+        hidden_2[neuron] = nnue_clip(nnue->l2_biases[neuron] + nnue_dot_avx2(hidden_1, nnue->l2_weights[neuron], NNUE_L1));
+    }
+
+    // Output
+    return (nnue->output_bias + nnue_dot_avx2(hidden_2, nnue->output_weights, NNUE_L2)) / NNUE_OUTPUT_SCALE;
+}
+
+#endif
+
+// Does the CPU have SSE4.1?
+int cpu_has_sse41() {
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_cpu_supports("sse4.1");
+#else
+    return 0;
+#endif
+}
+
+int cpu_has_avx2();
+
+// Selected NNUE kernels -> scalar until init_nnue() picks the best ones the CPU has
+void (*nnue_update_rows)(short *accumulator, const short **added, int added_count, const short **removed, int removed_count) = nnue_update_rows_scalar;
+int (*nnue_propagate)(const short *us, const short *them) = nnue_propagate_scalar;
+const char *nnue_kernel_name = "scalar";
+
+// NNUE kernel sets
+enum { nnue_scalar, nnue_sse41, nnue_avx2 };
+
+// Switch NNUE kernels -> returns 0 if the CPU can't run the ones asked for (the current ones stay)
+int set_nnue_kernels(int kernels) {
+#if defined(__x86_64__)
+    if (kernels == nnue_avx2) {
+        if (!cpu_has_avx2()) return 0;
+        nnue_update_rows = nnue_update_rows_avx2;
+        nnue_propagate = nnue_propagate_avx2;
+        nnue_kernel_name = "avx2";
+        return 1;
+    }
+    if (kernels == nnue_sse41) {
+        if (!cpu_has_sse41()) return 0;
+        nnue_update_rows = nnue_update_rows_sse41;
+        nnue_propagate = nnue_propagate_sse41;
+        nnue_kernel_name = "sse4.1";
+        return 1;
+    }
+#endif
+    if (kernels != nnue_scalar) return 0;
+    nnue_update_rows = nnue_update_rows_scalar;
+    nnue_propagate = nnue_propagate_scalar;
+    nnue_kernel_name = "scalar";
+    return 1;
+}
+
+// Pick the NNUE kernels
+void init_nnue() {
+    if (!set_nnue_kernels(nnue_avx2) && !set_nnue_kernels(nnue_sse41)) {
+        set_nnue_kernels(nnue_scalar);
+    }
+}
+
+// Rebuild one perspective's accumulator from the pieces on the board
+static inline void nnue_refresh_side(position *pos, int view) {
+    // The FEN parser allows more than 32 pieces (up to 62 besides the kings), so size it for a full board
+    const short *added[64];
+    int added_count = 0;
+    int king_square = get_ls1b_index(pos->bitboards[(view == white) ? K : k]);
+
+    // Every piece but the kings is a feature
+    for (int piece = P; piece <= k; piece++) {
+        if (piece == K || piece == k) continue;
+        U64 bitboard = pos->bitboards[piece];
+        while (bitboard) {
+            int square = get_ls1b_index(bitboard);
+            added[added_count++] = nnue->feature_weights[nnue_feature(view, king_square, piece, square)];
+            pop_bit(bitboard, square);
+        }
+    }
+
+    memcpy(pos->accumulator.values[view], nnue->feature_biases, sizeof(nnue->feature_biases));
+    nnue_update_rows(pos->accumulator.values[view], added, added_count, NULL, 0);
+}
+
+// Rebuild both accumulators
+void nnue_refresh_accumulators(position *pos) {
+    nnue_refresh_side(pos, white);
+    nnue_refresh_side(pos, black);
+}
+
+// Update the accumulators for a move that has just been made (or taken back) -> captured is the piece the move took off the
+// target square (-1 for none & for en passant)
+static inline void nnue_update_move(position *pos, int move, int captured, int taken_back) {
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = get_move_piece(move);
+    int promoted_piece = get_move_promoted(move);
+    int side = (piece >= p) ? black : white;
+
+    // Pieces the move takes off squares & puts on squares
+    int removed_pieces[3], removed_squares[3], added_pieces[2], added_squares[2];
+    int removed_count = 0, added_count = 0;
+
+    removed_pieces[removed_count] = piece; removed_squares[removed_count++] = source_square;
+    added_pieces[added_count] = promoted_piece ? promoted_piece : piece; added_squares[added_count++] = target_square;
+
+    if (get_move_enpassant(move)) {
+        removed_pieces[removed_count] = (side == white) ? p : P;
+        removed_squares[removed_count++] = (side == white) ? target_square + 8 : target_square - 8;
+    } else if (captured >= 0) {
+        removed_pieces[removed_count] = captured; removed_squares[removed_count++] = target_square;
+    }
+
+    if (get_move_castling(move)) {
+        int rook = (side == white) ? R : r;
+        removed_pieces[removed_count] = rook;
+        added_pieces[added_count] = rook;
+        switch (target_square) {
+            case g1: removed_squares[removed_count++] = h1; added_squares[added_count++] = f1; break;
+            case c1: removed_squares[removed_count++] = a1; added_squares[added_count++] = d1; break;
+            case g8: removed_squares[removed_count++] = h8; added_squares[added_count++] = f8; break;
+            default: removed_squares[removed_count++] = a8; added_squares[added_count++] = d8; break; // c8
+        }
+    }
+
+    for (int view = white; view <= black; view++) {
+        // The own king moved -> every feature of this perspective changes
+        if (view == side && (piece == K || piece == k)) {
+            nnue_refresh_side(pos, view);
+            continue;
+        }
+
+        // Weight rows to add & subtract (swapped when the move gets taken back), kings aren't features
+        int king_square = get_ls1b_index(pos->bitboards[(view == white) ? K : k]);
+        const short *add_rows[3], *remove_rows[3];
+        int add_count = 0, remove_count = 0;
+        for (int index = 0; index < removed_count; index++) {
+            if (removed_pieces[index] == K || removed_pieces[index] == k) continue;
+            const short *row = nnue->feature_weights[nnue_feature(view, king_square, removed_pieces[index], removed_squares[index])];
+            if (taken_back) add_rows[add_count++] = row; else remove_rows[remove_count++] = row;
+        }
+        for (int index = 0; index < added_count; index++) {
+            if (added_pieces[index] == K || added_pieces[index] == k) continue;
+            const short *row = nnue->feature_weights[nnue_feature(view, king_square, added_pieces[index], added_squares[index])];
+            if (taken_back) remove_rows[remove_count++] = row; else add_rows[add_count++] = row;
+        }
+
+        nnue_update_rows(pos->accumulator.values[view], add_rows, add_count, remove_rows, remove_count);
+    }
+}
+
+// Evaluate the position with the network -> score from the side to move's point of view
+static inline int nnue_evaluate(position *pos) {
+    // No incremental updates -> build the accumulators first
+    if (nnue_mode == nnue_refresh) {
+        nnue_refresh_accumulators(pos);
+    }
+
+    // Keep an odd network's output out of the mate score range
+    int score = nnue_propagate(pos->accumulator.values[pos->side], pos->accumulator.values[pos->side ^ 1]);
+    return (score > MATE_SCORE - 1) ? MATE_SCORE - 1 : (score < -MATE_SCORE + 1) ? -MATE_SCORE + 1 : score;
+}
+
+/*
+    Network file layout (little endian, no padding):
+
+    int32 magic ("BBHN"), int32 version (1), int32 hidden size (256)
+    int16 feature biases [256]
+    int16 feature weights [40960][256]           -> feature index = king square * 640 + (piece type * 2 + theirs) * 64 + square
+    int32 layer 1 biases [32],  int8 layer 1 weights [32][512]
+    int32 layer 2 biases [32],  int8 layer 2 weights [32][32]
+    int32 output bias,          int8 output weights [32]
+*/
+
+// Load a network -> returns 1 on success (the engine switches to it), 0 if the file can't be read or doesn't fit
+int nnue_load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return 0;
+
+    nnue_network *network = aligned_calloc(1, sizeof(nnue_network));
+    int header[3];
+    int ok = network != NULL &&
+             fread(header, sizeof(int), 3, file) == 3 &&
+             header[0] == NNUE_MAGIC && header[1] == NNUE_VERSION && header[2] == NNUE_HIDDEN &&
+             fread(network->feature_biases, sizeof(network->feature_biases), 1, file) == 1 &&
+             fread(network->feature_weights, sizeof(network->feature_weights), 1, file) == 1 &&
+             fread(network->l1_biases, sizeof(network->l1_biases), 1, file) == 1 &&
+             fread(network->l1_weights, sizeof(network->l1_weights), 1, file) == 1 &&
+             fread(network->l2_biases, sizeof(network->l2_biases), 1, file) == 1 &&
+             fread(network->l2_weights, sizeof(network->l2_weights), 1, file) == 1 &&
+             fread(&network->output_bias, sizeof(network->output_bias), 1, file) == 1 &&
+             fread(network->output_weights, sizeof(network->output_weights), 1, file) == 1 &&
+             fgetc(file) == EOF;
+    fclose(file);
+
+    if (!ok) {
+        aligned_free(network);
+        return 0;
+    }
+
+    // Swap the new network in
+    aligned_free(nnue);
+    nnue = network;
+    nnue_mode = nnue_incremental;
+    return 1;
+}
+
+// Fill a network with random weights -> for the benchmark when there's no network file (the scores are meaningless).
+// Returns 0 if there isn't enough memory (the old network stays).
+int nnue_init_random() {
+    nnue_network *network = aligned_calloc(1, sizeof(nnue_network));
+    if (network == NULL) return 0;
+    aligned_free(nnue);
+    nnue = network;
+
+    for (int neuron = 0; neuron < NNUE_HIDDEN; neuron++) nnue->feature_biases[neuron] = (short)(get_random_U32_number() % 64);
+    for (int feature = 0; feature < NNUE_INPUTS; feature++) {
+        for (int neuron = 0; neuron < NNUE_HIDDEN; neuron++) {
+            nnue->feature_weights[feature][neuron] = (short)((int)(get_random_U32_number() % 64) - 32);
+        }
+    }
+    for (int neuron = 0; neuron < NNUE_L1; neuron++) {
+        nnue->l1_biases[neuron] = (int)(get_random_U32_number() % 4096) - 2048;
+        for (int index = 0; index < 2 * NNUE_HIDDEN; index++) nnue->l1_weights[neuron][index] = (signed char)((int)(get_random_U32_number() % 32) - 16);
+    }
+    for (int neuron = 0; neuron < NNUE_L2; neuron++) {
+        nnue->l2_biases[neuron] = (int)(get_random_U32_number() % 4096) - 2048;
+        for (int index = 0; index < NNUE_L1; index++) nnue->l2_weights[neuron][index] = (signed char)((int)(get_random_U32_number() % 64) - 32);
+    }
+    nnue->output_bias = 0;
+    for (int index = 0; index < NNUE_L2; index++) nnue->output_weights[index] = (signed char)((int)(get_random_U32_number() % 64) - 32);
+    return 1;
+}
+
+/******************************************\
+===========================================
+
+            Make & Take Back
+
+===========================================
+\******************************************/
+
+/*
+    Two ways of playing & retracting moves, picked at compile time (so we can measure which is faster on a given machine):
+
+    -> Incremental make/unmake (default): make_move() XORs the moved pieces in & out of the piece and occupancy bitboards, and
+       pushes a compact undo record (the move + the few bits of state that can't be recovered from it). take_back() replays the
+       same XORs in reverse.
+
+    -> Copy-make (build with -DCOPY_MAKE): make_move() snapshots the whole board onto the undo stack before touching anything,
+       and take_back() simply copies the snapshot back.
+
+    Both variants use the same make_move()/take_back() interface, so nothing else in the engine has to care which one is in use.
+*/
+
+// Move types for make_move -> legal_move is for moves from the legal move generator (no need to check the king)
+enum { all_moves, only_captures, legal_move };
+
+/*
+    Castling rights update table -> pos->castle &= castling_rights[source] & castling_rights[target]
+
+    A king moving off its start square loses both of its rights, a rook moving off (or getting captured on) its corner loses
+    the right on that side. Every other square leaves the castling rights untouched (1111 = 15).
+
+                              castle   move     binary  decimal
+    king & rooks didn't move:   1111 & 1111  =  1111    15
+           white king moved:    1111 & 1100  =  1100    12
+    white king's rook moved:    1111 & 1110  =  1110    14
+   white queen's rook moved:    1111 & 1101  =  1101    13
+           black king moved:    1111 & 0011  =  0011    3
+    black king's rook moved:    1111 & 1011  =  1011    11
+   black queen's rook moved:    1111 & 0111  =  0111    7
+*/
+const int castling_rights[64] = {
+     7, 15, 15, 15,  3, 15, 15, 11,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    13, 15, 15, 15, 12, 15, 15, 14
+};
+
+// Take back the last move made with make_move
+static inline void take_back(position *pos) {
+    // Pop the undo record
+    undo *record = &pos->undo_stack[--pos->undo_count];
+
+#ifdef COPY_MAKE
+    // Restore the board snapshot
+    memcpy(pos->bitboards, record->bitboards, sizeof(pos->bitboards));
+    memcpy(pos->occupancies, record->occupancies, sizeof(pos->occupancies));
+    pos->side = record->side;
+    pos->full_moves = record->full_moves;
+#else
+    // Hand the move back to the side that made it
+    pos->side ^= 1;
+
+    // Full moves only go up after black moves
+    if (pos->side == black) {
+        pos->full_moves--;
+    }
+
+    // Parse the move
+    int move = record->move;
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = get_move_piece(move);
+    int promoted_piece = get_move_promoted(move);
+
+    // Source & target square bitboards
+    U64 target_bitboard = 1ULL << target_square;
+    U64 from_to = (1ULL << source_square) | target_bitboard;
+
+    // Undo the promotion -> turn the promoted piece back into a pawn on the target square
+    if (promoted_piece) {
+        pos->bitboards[promoted_piece] ^= target_bitboard;
+        pos->bitboards[piece] ^= target_bitboard;
+    }
+
+    // Move the piece back
+    pos->bitboards[piece] ^= from_to;
+    pos->occupancies[pos->side] ^= from_to;
+    pos->occupancies[both] ^= from_to;
+
+    // Put the captured piece back
+    if (get_move_enpassant(move)) {
+        // En passant -> the captured pawn sits right behind the target square
+        U64 captured_bitboard = (pos->side == white) ? (target_bitboard << 8) : (target_bitboard >> 8);
+        pos->bitboards[(pos->side == white) ? p : P] ^= captured_bitboard;
+        pos->occupancies[pos->side ^ 1] ^= captured_bitboard;
+        pos->occupancies[both] ^= captured_bitboard;
+    } else if (record->captured >= 0) {
+        pos->bitboards[record->captured] ^= target_bitboard;
+        pos->occupancies[pos->side ^ 1] ^= target_bitboard;
+        pos->occupancies[both] ^= target_bitboard;
+    }
+
+    // Move the castling rook back
+    if (get_move_castling(move)) {
+        U64 rook_from_to;
+        switch (target_square) {
+            case g1: rook_from_to = (1ULL << h1) | (1ULL << f1); break;
+            case c1: rook_from_to = (1ULL << a1) | (1ULL << d1); break;
+            case g8: rook_from_to = (1ULL << h8) | (1ULL << f8); break;
+            default: rook_from_to = (1ULL << a8) | (1ULL << d8); break; // c8
+        }
+        pos->bitboards[(pos->side == white) ? R : r] ^= rook_from_to;
+        pos->occupancies[pos->side] ^= rook_from_to;
+        pos->occupancies[both] ^= rook_from_to;
+    }
+#endif
+
+    // Take the move back out of the NNUE accumulators (the board is back, so a king move's refresh sees the old king square)
+    if (nnue_mode == nnue_incremental) {
+        nnue_update_move(pos, record->move, record->captured, 1);
+    }
+
+    // Restore the irreversible state
+    pos->hash_key = record->hash_key;
+    pos->pawn_key = record->pawn_key;
+    pos->psq_score = record->psq_score;
+    pos->phase = record->phase;
+    pos->enpassant = record->enpassant;
+    pos->castle = record->castle;
+    pos->half_moves = record->half_moves;
+}
+
+// Make a move -> returns 1 if the move is legal, 0 otherwise (an illegal move gets taken back before returning)
+// (Called through make_move, which points at the version for the selected slider backend.)
+static inline __attribute__((always_inline)) int make_move_backend(position *pos, int move, int move_flag, int backend) {
+    // Quiet moves aren't wanted -> don't make the move
+    if (move_flag == only_captures && !get_move_capture(move)) {
+        return 0;
+    }
+
+    // Parse the move
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = get_move_piece(move);
+    int promoted_piece = get_move_promoted(move);
+    int capture = get_move_capture(move);
+    int enpass = get_move_enpassant(move);
+
+    // Push the undo record
+    undo *record = &pos->undo_stack[pos->undo_count++];
+#ifdef COPY_MAKE
+    memcpy(record->bitboards, pos->bitboards, sizeof(pos->bitboards));
+    memcpy(record->occupancies, pos->occupancies, sizeof(pos->occupancies));
+    record->side = pos->side;
+    record->full_moves = pos->full_moves;
+#endif
+    record->hash_key = pos->hash_key;
+    record->pawn_key = pos->pawn_key;
+    record->psq_score = pos->psq_score;
+    record->phase = pos->phase;
+    record->move = move;
+    record->captured = -1;
+    record->enpassant = pos->enpassant;
+    record->castle = pos->castle;
+    record->half_moves = pos->half_moves;
+
+    // Source & target square bitboards
+    U64 target_bitboard = 1ULL << target_square;
+    U64 from_to = (1ULL << source_square) | target_bitboard;
+
+    // Move the piece
+    pos->bitboards[piece] ^= from_to;
+    pos->occupancies[pos->side] ^= from_to;
+    pos->occupancies[both] ^= from_to;
+    pos->hash_key ^= piece_keys[piece][source_square] ^ piece_keys[piece][target_square];
+    pos->psq_score += piece_square_values[piece][target_square] - piece_square_values[piece][source_square];
+    if (piece == P || piece == p) {
+        pos->pawn_key ^= piece_keys[piece][source_square] ^ piece_keys[piece][target_square];
+    }
+
+    // Remove the captured piece
+    if (enpass) {
+        // En passant -> the captured pawn sits right behind the target square
+        U64 captured_bitboard = (pos->side == white) ? (target_bitboard << 8) : (target_bitboard >> 8);
+        pos->bitboards[(pos->side == white) ? p : P] ^= captured_bitboard;
+        pos->occupancies[pos->side ^ 1] ^= captured_bitboard;
+        pos->occupancies[both] ^= captured_bitboard;
+        pos->hash_key ^= piece_keys[(pos->side == white) ? p : P][(pos->side == white) ? target_square + 8 : target_square - 8];
+        pos->psq_score -= piece_square_values[(pos->side == white) ? p : P][(pos->side == white) ? target_square + 8 : target_square - 8];
+        pos->pawn_key ^= piece_keys[(pos->side == white) ? p : P][(pos->side == white) ? target_square + 8 : target_square - 8];
+    } else if (capture) {
+        // Pick up the opponent's piece bitboard range
+        int start_piece = (pos->side == white) ? p : P;
+        int end_piece = (pos->side == white) ? k : K;
+
+        // Find the piece sitting on the target square
+        for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++) {
+            if (pos->bitboards[bb_piece] & target_bitboard) {
+                // Remove it from its bitboard & remember it for take_back
+                pos->bitboards[bb_piece] ^= target_bitboard;
+                pos->hash_key ^= piece_keys[bb_piece][target_square];
+                pos->psq_score -= piece_square_values[bb_piece][target_square];
+                pos->phase -= phase_values[bb_piece];
+                if (bb_piece == P || bb_piece == p) {
+                    pos->pawn_key ^= piece_keys[bb_piece][target_square];
+                }
+                record->captured = bb_piece;
+                break;
+            }
+        }
+
+        // The target square stays occupied (by us now), so only the opponent's occupancy changes
+        pos->occupancies[pos->side ^ 1] ^= target_bitboard;
+        pos->occupancies[both] ^= target_bitboard;
+    }
+
+    // Pawn promotion -> swap the pawn on the target square for the promoted piece
+    if (promoted_piece) {
+        pos->bitboards[piece] ^= target_bitboard;
+        pos->bitboards[promoted_piece] ^= target_bitboard;
+        pos->hash_key ^= piece_keys[piece][target_square] ^ piece_keys[promoted_piece][target_square];
+        pos->psq_score += piece_square_values[promoted_piece][target_square] - piece_square_values[piece][target_square];
+        pos->phase += phase_values[promoted_piece];
+        pos->pawn_key ^= piece_keys[piece][target_square];
+    }
+
+    // Castling -> move the rook too
+    if (get_move_castling(move)) {
+        int rook_source, rook_target;
+        switch (target_square) {
+            case g1: rook_source = h1; rook_target = f1; break;
+            case c1: rook_source = a1; rook_target = d1; break;
+            case g8: rook_source = h8; rook_target = f8; break;
+            default: rook_source = a8; rook_target = d8; break; // c8
+        }
+        int rook = (pos->side == white) ? R : r;
+        U64 rook_from_to = (1ULL << rook_source) | (1ULL << rook_target);
+        pos->bitboards[rook] ^= rook_from_to;
+        pos->occupancies[pos->side] ^= rook_from_to;
+        pos->occupancies[both] ^= rook_from_to;
+        pos->hash_key ^= piece_keys[rook][rook_source] ^ piece_keys[rook][rook_target];
+        pos->psq_score += piece_square_values[rook][rook_target] - piece_square_values[rook][rook_source];
+    }
+
+    // Update the NNUE accumulators
+    if (nnue_mode == nnue_incremental) {
+        nnue_update_move(pos, move, record->captured, 0);
+    }
+
+    // Hash the old en passant square out
+    if (pos->enpassant != no_sq) {
+        pos->hash_key ^= enpassant_keys[pos->enpassant];
+    }
+
+    // Set the en passant square after a double pawn push (& hash it in), reset it otherwise
+    pos->enpassant = get_move_double(move) ? ((pos->side == white) ? target_square + 8 : target_square - 8) : no_sq;
+    if (pos->enpassant != no_sq) {
+        pos->hash_key ^= enpassant_keys[pos->enpassant];
+    }
+
+    // Update the castling rights (hash the old rights out & the new ones in)
+    pos->hash_key ^= castle_keys[pos->castle];
+    pos->castle &= castling_rights[source_square] & castling_rights[target_square];
+    pos->hash_key ^= castle_keys[pos->castle];
+
+    // Update the fifty move counter -> reset on pawn moves & captures
+    pos->half_moves = (piece == P || piece == p || capture) ? 0 : pos->half_moves + 1;
+
+    // Full moves go up after black moves
+    if (pos->side == black) {
+        pos->full_moves++;
+    }
+
+    // Change sides
+    pos->side ^= 1;
+    pos->hash_key ^= side_key;
+
+    // The child's hash key is known now -> start pulling its transposition table bucket into the cache
+    tt_prefetch(pos->hash_key);
+
+#ifdef DEBUG_HASH
+    // Make sure the incrementally updated hash key matches a full recomputation
+    if (pos->hash_key != generate_hash_key(pos)) {
+        printf("\n    Hash key mismatch after move ");
+        print_move(move);
+        printf(": incremental %llx, recomputed %llx\n", pos->hash_key, generate_hash_key(pos));
+        print_board(pos);
+        abort();
+    }
+
+    // Same for the pawn key
+    if (pos->pawn_key != generate_pawn_key(pos)) {
+        printf("\n    Pawn key mismatch after move ");
+        print_move(move);
+        printf(": incremental %llx, recomputed %llx\n", pos->pawn_key, generate_pawn_key(pos));
+        print_board(pos);
+        abort();
+    }
+
+    // & for the material & piece-square score & the game phase
+    int psq_score = pos->psq_score, phase = pos->phase;
+    generate_evaluation(pos);
+    if (pos->psq_score != psq_score || pos->phase != phase) {
+        printf("\n    Evaluation mismatch after move ");
+        print_move(move);
+        printf(": incremental %d/%d phase %d, recomputed %d/%d phase %d\n", score_mg(psq_score), score_eg(psq_score), phase,
+               score_mg(pos->psq_score), score_eg(pos->psq_score), pos->phase);
+        print_board(pos);
+        abort();
+    }
+
+    // & for the NNUE accumulators
+    if (nnue_mode == nnue_incremental) {
+        nnue_accumulator accumulator = pos->accumulator;
+        nnue_refresh_accumulators(pos);
+        if (memcmp(&accumulator, &pos->accumulator, sizeof(accumulator))) {
+            printf("\n    NNUE accumulator mismatch after move ");
+            print_move(move);
+            printf("\n");
+            print_board(pos);
+            abort();
+        }
+    }
+#endif
+
+    // Make sure that the king of the side that just moved isn't left in check
+    if (move_flag != legal_move && is_square_attacked_backend(pos, get_ls1b_index(pos->bitboards[(pos->side == white) ? k : K]), pos->side, backend)) {
+        // Illegal move -> take it back
+        take_back(pos);
+        return 0;
+    }
+
+    // Legal move
+    return 1;
+}
+
+// Make a null move (pass the turn) -> used by null move pruning, never legal in a real game
+static inline void make_null_move(position *pos) {
+    // Push the undo record (the board itself doesn't change, so even copy-make doesn't need a snapshot)
+    undo *record = &pos->undo_stack[pos->undo_count++];
+    record->hash_key = pos->hash_key;
+    record->move = 0;
+    record->captured = -1;
+    record->enpassant = pos->enpassant;
+    record->castle = pos->castle;
+    record->half_moves = pos->half_moves;
+
+    // The en passant square expires
+    if (pos->enpassant != no_sq) {
+        pos->hash_key ^= enpassant_keys[pos->enpassant];
+        pos->enpassant = no_sq;
+    }
+
+    // Change sides
+    pos->side ^= 1;
+    pos->hash_key ^= side_key;
+    pos->half_moves++;
+}
+
+// Take back a null move
+static inline void take_back_null_move(position *pos) {
+    // Pop the undo record
+    undo *record = &pos->undo_stack[--pos->undo_count];
+
+    // Hand the turn back & restore the state
+    pos->side ^= 1;
+    pos->hash_key = record->hash_key;
+    pos->enpassant = record->enpassant;
+    pos->half_moves = record->half_moves;
+}
+
+// Is the pseudo-legal move legal? -> same answer as make_move's king check, but without touching the board.
+// Looks at the king square with the occupancy the move would leave behind & ignores the attackers the move captures.
+// (Called through is_move_legal, which points at the version for the selected slider backend.)
+static inline __attribute__((always_inline)) int is_move_legal_backend(position *pos, int move, int backend) {
+    // Parse the move
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = get_move_piece(move);
+
+    // Source & target square bitboards
+    U64 target_bitboard = 1ULL << target_square;
+
+    // Occupancy after the move & pieces removed from the board by it
+    U64 occupancy = (pos->occupancies[both] ^ (1ULL << source_square)) | target_bitboard;
+    U64 captured = target_bitboard;
+
+    // En passant -> the captured pawn sits right behind the target square
+    if (get_move_enpassant(move)) {
+        U64 captured_bitboard = (pos->side == white) ? (target_bitboard << 8) : (target_bitboard >> 8);
+        occupancy ^= captured_bitboard;
+        captured |= captured_bitboard;
+    }
+
+    // King square after the move
+    int king_square = (piece == K || piece == k) ? target_square : get_ls1b_index(pos->bitboards[(pos->side == white) ? K : k]);
+
+    // Opponent's piece bitboard offset (white pieces come first in the piece enumeration)
+    int offset = (pos->side == white) ? p : P;
+
+    // Attacked by pawns
+    if (pawn_attacks[pos->side][king_square] & pos->bitboards[offset + P] & ~captured) return 0;
+
+    // Attacked by knights
+    if (knight_attacks[king_square] & pos->bitboards[offset + N] & ~captured) return 0;
+
+    // Attacked by bishops or queens
+    if (get_bishop_attacks(king_square, occupancy, backend) & (pos->bitboards[offset + B] | pos->bitboards[offset + Q]) & ~captured) return 0;
+
+    // Attacked by rooks or queens
+    if (get_rook_attacks(king_square, occupancy, backend) & (pos->bitboards[offset + R] | pos->bitboards[offset + Q]) & ~captured) return 0;
+
+    // Attacked by the king
+    if (king_attacks[king_square] & pos->bitboards[offset + K]) return 0;
+
+    // Legal move
+    return 1;
+}
+
+/******************************************\
+===========================================
+
+             Fill Attacks
+
+===========================================
+\******************************************/
+
+/*
+    Kogge-Stone (occluded fill) slider attacks -> instead of looking up one slider at a time, all the sliders of a side get
+    smeared along a direction at once: every step doubles the distance covered (1, 2, 4 squares), the "propagator" (empty
+    squares, minus the file the shift would wrap onto) stops the fill at the first blocker, & one last shift turns the
+    filled squares into attacked ones. 8 directions x 3 steps gives the attack set of every rook, bishop & queen of a side.
+
+    -> Scalar: one direction of one side at a time (works anywhere)
+    -> SSE2 (every x86-64): white & black in the two lanes, so both sides go through a direction together
+    -> AVX2: 4 directions per vector -> the 4 that shift left (towards h1) in one, the 4 that shift right in another
+
+    The fastest one the CPU has gets picked at startup (cpuid), & attack_maps() builds whole-side attack sets with it.
+*/
+
+// Kogge-Stone fill towards h1 (left shift) -> returns the squares attacked along the direction
+static inline U64 fill_attacks_left(U64 sliders, U64 empty, int shift, U64 wrap) {
+    U64 propagator = empty & wrap;
+    sliders |= propagator & (sliders << shift);
+    propagator &= propagator << shift;
+    sliders |= propagator & (sliders << (2 * shift));
+    propagator &= propagator << (2 * shift);
+    sliders |= propagator & (sliders << (4 * shift));
+    return (sliders << shift) & wrap;
+}
+
+// Kogge-Stone fill towards a8 (right shift)
+static inline U64 fill_attacks_right(U64 sliders, U64 empty, int shift, U64 wrap) {
+    U64 propagator = empty & wrap;
+    sliders |= propagator & (sliders >> shift);
+    propagator &= propagator >> shift;
+    sliders |= propagator & (sliders >> (2 * shift));
+    propagator &= propagator >> (2 * shift);
+    sliders |= propagator & (sliders >> (4 * shift));
+    return (sliders >> shift) & wrap;
+}
+
+// Slider attacks of one side, one direction at a time -> orthogonal = rooks & queens, diagonal = bishops & queens
+U64 fill_side_attacks_scalar(U64 orthogonal, U64 diagonal, U64 empty) {
+    return fill_attacks_left(orthogonal, empty, 8, ~0ULL)        // south
+         | fill_attacks_left(orthogonal, empty, 1, not_a_file)   // east
+         | fill_attacks_right(orthogonal, empty, 8, ~0ULL)       // north
+         | fill_attacks_right(orthogonal, empty, 1, not_h_file)  // west
+         | fill_attacks_left(diagonal, empty, 9, not_a_file)     // south east
+         | fill_attacks_left(diagonal, empty, 7, not_h_file)     // south west
+         | fill_attacks_right(diagonal, empty, 9, not_h_file)    // north west
+         | fill_attacks_right(diagonal, empty, 7, not_a_file);   // north east
+}
+
+// Slider attacks of both sides, one direction at a time (by side)
+void fill_attacks_scalar(const U64 *orthogonal, const U64 *diagonal, U64 empty, U64 *attacks) {
+    for (int side = white; side <= black; side++) {
+        attacks[side] = fill_side_attacks_scalar(orthogonal[side], diagonal[side], empty);
+    }
+}
+
+#if defined(__x86_64__)
+
+// SSE2 fill towards h1 -> white in the low lane, black in the high one
+static inline __m128i fill_attacks_left_sse2(__m128i sliders, __m128i empty, int shift, U64 wrap) {
+    __m128i wrap_mask = _mm_set1_epi64x((long long)wrap);
+    __m128i propagator = _mm_and_si128(empty, wrap_mask);
+    sliders = _mm_or_si128(sliders, _mm_and_si128(propagator, _mm_sll_epi64(sliders, _mm_cvtsi32_si128(shift))));
+    propagator = _mm_and_si128(propagator, _mm_sll_epi64(propagator, _mm_cvtsi32_si128(shift)));
+    sliders = _mm_or_si128(sliders, _mm_and_si128(propagator, _mm_sll_epi64(sliders, _mm_cvtsi32_si128(2 * shift))));
+    propagator = _mm_and_si128(propagator, _mm_sll_epi64(propagator, _mm_cvtsi32_si128(2 * shift)));
+    sliders = _mm_or_si128(sliders, _mm_and_si128(propagator, _mm_sll_epi64(sliders, _mm_cvtsi32_si128(4 * shift))));
+    return _mm_and_si128(_mm_sll_epi64(sliders, _mm_cvtsi32_si128(shift)), wrap_mask);
+}
+
+// SSE2 fill towards a8
+static inline __m128i fill_attacks_right_sse2(__m128i sliders, __m128i empty, int shift, U64 wrap) {
+    __m128i wrap_mask = _mm_set1_epi64x((long long)wrap);
+    __m128i propagator = _mm_and_si128(empty, wrap_mask);
+    sliders = _mm_or_si128(sliders, _mm_and_si128(propagator, _mm_srl_epi64(sliders, _mm_cvtsi32_si128(shift))));
+    propagator = _mm_and_si128(propagator, _mm_srl_epi64(propagator, _mm_cvtsi32_si128(shift)));
+    sliders = _mm_or_si128(sliders, _mm_and_si128(propagator, _mm_srl_epi64(sliders, _mm_cvtsi32_si128(2 * shift))));
+    propagator = _mm_and_si128(propagator, _mm_srl_epi64(propagator, _mm_cvtsi32_si128(2 * shift)));
+    sliders = _mm_or_si128(sliders, _mm_and_si128(propagator, _mm_srl_epi64(sliders, _mm_cvtsi32_si128(4 * shift))));
+    return _mm_and_si128(_mm_srl_epi64(sliders, _mm_cvtsi32_si128(shift)), wrap_mask);
+}
+
+// Slider attacks of both sides, both sides per instruction
+void fill_attacks_sse2(const U64 *orthogonal, const U64 *diagonal, U64 empty, U64 *attacks) {
+    __m128i orthogonal_sliders = _mm_loadu_si128((const __m128i *)orthogonal);
+    __m128i diagonal_sliders = _mm_loadu_si128((const __m128i *)diagonal);
+    __m128i empty_squares = _mm_set1_epi64x((long long)empty);
+
+    __m128i result = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(fill_attacks_left_sse2(orthogonal_sliders, empty_squares, 8, ~0ULL),
+                                  fill_attacks_left_sse2(orthogonal_sliders, empty_squares, 1, not_a_file)),
+                     _mm_or_si128(fill_attacks_right_sse2(orthogonal_sliders, empty_squares, 8, ~0ULL),
+                                  fill_attacks_right_sse2(orthogonal_sliders, empty_squares, 1, not_h_file))),
+        _mm_or_si128(_mm_or_si128(fill_attacks_left_sse2(diagonal_sliders, empty_squares, 9, not_a_file),
+                                  fill_attacks_left_sse2(diagonal_sliders, empty_squares, 7, not_h_file)),
+                     _mm_or_si128(fill_attacks_right_sse2(diagonal_sliders, empty_squares, 9, not_h_file),
+                                  fill_attacks_right_sse2(diagonal_sliders, empty_squares, 7, not_a_file))));
+
+    _mm_storeu_si128((__m128i *)attacks, result);
+}
+
+// Slider attacks of one side, 4 directions per instruction -> lanes (low to high): south, east, south east, south west
+// for the left shifts & north, west, north west, north east for the right ones
+__attribute__((target("avx2"))) U64 fill_side_attacks_avx2(U64 orthogonal, U64 diagonal, U64 empty) {
+    const __m256i shift_1 = _mm256_set_epi64x(7, 9, 1, 8);
+    const __m256i shift_2 = _mm256_add_epi64(shift_1, shift_1);
+    const __m256i shift_4 = _mm256_add_epi64(shift_2, shift_2);
+    const __m256i left_wrap = _mm256_set_epi64x((long long)not_h_file, (long long)not_a_file, (long long)not_a_file, -1LL);
+    const __m256i right_wrap = _mm256_set_epi64x((long long)not_a_file, (long long)not_h_file, (long long)not_h_file, -1LL);
+    const __m256i sliders = _mm256_set_epi64x((long long)diagonal, (long long)diagonal, (long long)orthogonal, (long long)orthogonal);
+    const __m256i empty_squares = _mm256_set1_epi64x((long long)empty);
+
+    // Towards h1
+    __m256i left = sliders;
+    __m256i propagator = _mm256_and_si256(empty_squares, left_wrap);
+    left = _mm256_or_si256(left, _mm256_and_si256(propagator, _mm256_sllv_epi64(left, shift_1)));
+    propagator = _mm256_and_si256(propagator, _mm256_sllv_epi64(propagator, shift_1));
+    left = _mm256_or_si256(left, _mm256_and_si256(propagator, _mm256_sllv_epi64(left, shift_2)));
+    propagator = _mm256_and_si256(propagator, _mm256_sllv_epi64(propagator, shift_2));
+    left = _mm256_or_si256(left, _mm256_and_si256(propagator, _mm256_sllv_epi64(left, shift_4)));
+    left = _mm256_and_si256(_mm256_sllv_epi64(left, shift_1), left_wrap);
+
+    // Towards a8
+    __m256i right = sliders;
+    propagator = _mm256_and_si256(empty_squares, right_wrap);
+    right = _mm256_or_si256(right, _mm256_and_si256(propagator, _mm256_srlv_epi64(right, shift_1)));
+    propagator = _mm256_and_si256(propagator, _mm256_srlv_epi64(propagator, shift_1));
+    right = _mm256_or_si256(right, _mm256_and_si256(propagator, _mm256_srlv_epi64(right, shift_2)));
+    propagator = _mm256_and_si256(propagator, _mm256_srlv_epi64(propagator, shift_2));
+    right = _mm256_or_si256(right, _mm256_and_si256(propagator, _mm256_srlv_epi64(right, shift_4)));
+    right = _mm256_and_si256(_mm256_srlv_epi64(right, shift_1), right_wrap);
+
+    // OR the 8 directions together
+    __m256i all = _mm256_or_si256(left, right);
+    __m128i half = _mm_or_si128(_mm256_castsi256_si128(all), _mm256_extracti128_si256(all, 1));
+    return (U64)_mm_cvtsi128_si64(_mm_or_si128(half, _mm_unpackhi_epi64(half, half)));
+}
+
+// Slider attacks of both sides, 4 directions per instruction
+__attribute__((target("avx2"))) void fill_attacks_avx2(const U64 *orthogonal, const U64 *diagonal, U64 empty, U64 *attacks) {
+    attacks[white] = fill_side_attacks_avx2(orthogonal[white], diagonal[white], empty);
+    attacks[black] = fill_side_attacks_avx2(orthogonal[black], diagonal[black], empty);
+}
+
+#endif
+
+// Does the CPU have AVX2?
+int cpu_has_avx2() {
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+// Selected fill attack generators (both sides & one side) -> scalar until init_fill_attacks() picks the best ones the CPU has.
+// SSE2 only pays off with both sides in the lanes, so one side on its own stays scalar without AVX2.
+void (*fill_attacks)(const U64 *orthogonal, const U64 *diagonal, U64 empty, U64 *attacks) = fill_attacks_scalar;
+U64 (*fill_side_attacks)(U64 orthogonal, U64 diagonal, U64 empty) = fill_side_attacks_scalar;
+const char *fill_attacks_name = "scalar";
+
+// Pick the fill attack generator
+void init_fill_attacks() {
+#if defined(__x86_64__)
+    if (cpu_has_avx2()) {
+        fill_attacks = fill_attacks_avx2;
+        fill_side_attacks = fill_side_attacks_avx2;
+        fill_attacks_name = "avx2";
+    } else {
+        fill_attacks = fill_attacks_sse2;
+        fill_attacks_name = "sse2";
+    }
+#endif
+}
+
+// Every square one side attacks, given the occupancy
+static inline U64 attack_map(position *pos, int side, U64 occupancy) {
+    int offset = (side == white) ? P : p;
+
+    // Sliders -> all of them at once
+    U64 attacks = fill_side_attacks(pos->bitboards[offset + R] | pos->bitboards[offset + Q],
+                                    pos->bitboards[offset + B] | pos->bitboards[offset + Q], ~occupancy);
+
+    // Pawns -> the whole bitboard shifted diagonally forward
+    if (side == white) {
+        attacks |= ((pos->bitboards[P] >> 7) & not_a_file) | ((pos->bitboards[P] >> 9) & not_h_file);
+    } else {
+        attacks |= ((pos->bitboards[p] << 7) & not_h_file) | ((pos->bitboards[p] << 9) & not_a_file);
+    }
+
+    // Knights & king
+    U64 knights = pos->bitboards[offset + N];
+    while (knights) {
+        int square = get_ls1b_index(knights);
+        attacks |= knight_attacks[square];
+        pop_bit(knights, square);
+    }
+    return attacks | king_attacks[get_ls1b_index(pos->bitboards[offset + K])];
+}
+
+// Every square each side attacks, given the occupancy -> attacks[white] & attacks[black].
+// The occupancy is a parameter so callers can look "through" pieces (e.g. the king that's about to step away from a slider).
+void attack_maps(position *pos, U64 occupancy, U64 *attacks) {
+    // Sliders -> all of them at once
+    U64 orthogonal[2] = { pos->bitboards[R] | pos->bitboards[Q], pos->bitboards[r] | pos->bitboards[q] };
+    U64 diagonal[2] = { pos->bitboards[B] | pos->bitboards[Q], pos->bitboards[b] | pos->bitboards[q] };
+    fill_attacks(orthogonal, diagonal, ~occupancy, attacks);
+
+    // Pawns -> the whole bitboard shifted diagonally forward
+    attacks[white] |= ((pos->bitboards[P] >> 7) & not_a_file) | ((pos->bitboards[P] >> 9) & not_h_file);
+    attacks[black] |= ((pos->bitboards[p] << 7) & not_h_file) | ((pos->bitboards[p] << 9) & not_a_file);
+
+    // Knights & kings
+    for (int side = white; side <= black; side++) {
+        U64 knights = pos->bitboards[(side == white) ? N : n];
+        while (knights) {
+            int square = get_ls1b_index(knights);
+            attacks[side] |= knight_attacks[square];
+            pop_bit(knights, square);
+        }
+        U64 king = pos->bitboards[(side == white) ? K : k];
+        if (king) attacks[side] |= king_attacks[get_ls1b_index(king)];
+    }
+}
+
+/******************************************\
+===========================================
+
+          Legal Move Generator
+
+===========================================
+\******************************************/
+
+/*
+    Fully legal move generation -> instead of generating pseudo-legal moves & letting make_move throw out the ones that
+    leave the king in check, work out up front what the king's situation allows:
+
+    -> checkers: enemy pieces attacking the king. Two of them (double check) -> only king moves can help, so stop there.
+    -> check mask: with one checker, the other pieces can only capture it or step in between (between_squares)
+    -> pinned pieces: enemy sliders that see the king through exactly one of our pieces (found by looking out from the
+       king with only the enemy pieces as blockers) -> a pinned piece can only move along the pin line (line_squares)
+    -> king danger: every square the enemy attacks with our king taken off the board (attack_map), so the king can't
+       "hide" behind itself along a checking slider's line
+    -> en passant removes two pawns from a rank at once, so it gets checked by looking for slider attacks on the king
+       with the occupancy after the capture
+
+    Moves from here are made with make_move(pos, move, legal_move), which skips the king check.
+
+    The search asks for the moves in stages (see the move picker), so the generator can hand out just one kind of move:
+    -> gen_noisy: captures (en passant included) & promotions
+    -> gen_quiet: everything else (castling included)
+*/
+
+// Kinds of moves the legal move generator hands out
+enum { gen_all, gen_noisy, gen_quiet };
+
+// Add a pawn move -> all four promotions if it lands on the last rank
+static inline void add_pawn_moves(moves *move_list, int source_square, int target_square, int piece, int capture) {
+    if (target_square <= h8 || target_square >= a1) {
+        // Promotion pieces of the pawn's colour
+        int offset = (piece == P) ? 0 : 6;
+        add_move(move_list, encode_move(source_square, target_square, piece, Q + offset, capture, 0, 0, 0));
+        add_move(move_list, encode_move(source_square, target_square, piece, R + offset, capture, 0, 0, 0));
+        add_move(move_list, encode_move(source_square, target_square, piece, B + offset, capture, 0, 0, 0));
+        add_move(move_list, encode_move(source_square, target_square, piece, N + offset, capture, 0, 0, 0));
+    } else {
+        add_move(move_list, encode_move(source_square, target_square, piece, 0, capture, 0, 0, 0));
+    }
+}
+
+// Generate the legal moves of the given kind for the side to move
+// (Called through generate_legal_moves/_noisy/_quiets, which point at the versions for the selected slider backend.)
+static inline __attribute__((always_inline)) void generate_legal_moves_backend(position *pos, moves *move_list, int backend, int gen_type) {
+    // Reset the move count
+    move_list->count = 0;
+
+    // Sides & piece bitboard offsets (white pieces come first in the piece enumeration)
+    int side = pos->side, enemy = pos->side ^ 1;
+    int offset = (side == white) ? P : p;
+    int enemy_offset = (side == white) ? p : P;
+
+    // Occupancies
+    U64 occupancy = pos->occupancies[both];
+    U64 own = pos->occupancies[side];
+    U64 enemies = pos->occupancies[enemy];
+
+    // Enemy sliders
+    U64 enemy_orthogonal = pos->bitboards[enemy_offset + R] | pos->bitboards[enemy_offset + Q];
+    U64 enemy_diagonal = pos->bitboards[enemy_offset + B] | pos->bitboards[enemy_offset + Q];
+
+    // King square
+    int king_square = get_ls1b_index(pos->bitboards[offset + K]);
+
+    // Enemy pieces giving check
+    U64 checkers = (pawn_attacks[side][king_square] & pos->bitboards[enemy_offset + P])
+                 | (knight_attacks[king_square] & pos->bitboards[enemy_offset + N])
+                 | (get_bishop_attacks(king_square, occupancy, backend) & enemy_diagonal)
+                 | (get_rook_attacks(king_square, occupancy, backend) & enemy_orthogonal);
+
+    // Squares the king can't go to -> everything the enemy attacks, seen through our king
+    U64 danger = attack_map(pos, enemy, occupancy ^ pos->bitboards[offset + K]);
+
+    // Squares the moves may land on -> enemy pieces for captures, empty squares for quiet moves
+    U64 targets = (gen_type == gen_noisy) ? enemies : (gen_type == gen_quiet) ? ~occupancy : ~own;
+
+    // King moves
+    U64 attacks = king_attacks[king_square] & targets & ~danger;
+    while (attacks) {
+        int target_square = get_ls1b_index(attacks);
+        add_move(move_list, encode_move(king_square, target_square, offset + K, 0, get_bit(enemies, target_square) ? 1 : 0, 0, 0, 0));
+        pop_bit(attacks, target_square);
+    }
+
+    // Double check -> only the king can get out of it
+    if (checkers & (checkers - 1)) {
+        return;
+    }
+
+    // Squares that deal with a check -> capture the checker or block it (anything goes when not in check)
+    U64 check_mask = checkers ? (checkers | between_squares[king_square][get_ls1b_index(checkers)]) : ~0ULL;
+
+    // Pinned pieces -> enemy sliders looking at the king through exactly one of our pieces
+    U64 pinned = 0ULL;
+    U64 snipers = (get_bishop_attacks(king_square, enemies, backend) & enemy_diagonal)
+                | (get_rook_attacks(king_square, enemies, backend) & enemy_orthogonal);
+    while (snipers) {
+        int sniper_square = get_ls1b_index(snipers);
+        U64 blockers = between_squares[king_square][sniper_square] & occupancy;
+        if (blockers && !(blockers & (blockers - 1))) {
+            pinned |= blockers & own;
+        }
+        pop_bit(snipers, sniper_square);
+    }
+
+    // Castling -> not in check, squares in between empty & the squares the king crosses not attacked
+    if (!checkers && gen_type != gen_noisy) {
+        if (side == white) {
+            if ((pos->castle & wk) && !(occupancy & ((1ULL << f1) | (1ULL << g1))) && !(danger & ((1ULL << f1) | (1ULL << g1)))) {
+                add_move(move_list, encode_move(e1, g1, K, 0, 0, 0, 0, 1));
+            }
+            if ((pos->castle & wq) && !(occupancy & ((1ULL << d1) | (1ULL << c1) | (1ULL << b1))) && !(danger & ((1ULL << d1) | (1ULL << c1)))) {
+                add_move(move_list, encode_move(e1, c1, K, 0, 0, 0, 0, 1));
+            }
+        } else {
+            if ((pos->castle & bk) && !(occupancy & ((1ULL << f8) | (1ULL << g8))) && !(danger & ((1ULL << f8) | (1ULL << g8)))) {
+                add_move(move_list, encode_move(e8, g8, k, 0, 0, 0, 0, 1));
+            }
+            if ((pos->castle & bq) && !(occupancy & ((1ULL << d8) | (1ULL << c8) | (1ULL << b8))) && !(danger & ((1ULL << d8) | (1ULL << c8)))) {
+                add_move(move_list, encode_move(e8, c8, k, 0, 0, 0, 0, 1));
+            }
+        }
+    }
+
+    // Pawns -> white pawns move towards a8 (down the square numbers), black ones towards h1
+    int push = (side == white) ? -8 : 8;
+    U64 start_rank = (side == white) ? 0x00ff000000000000ULL : 0x000000000000ff00ULL;
+    U64 bitboard = pos->bitboards[offset + P];
+    while (bitboard) {
+        int source_square = get_ls1b_index(bitboard);
+
+        // Where this pawn may go -> onto the check mask, & along the pin line if it's pinned
+        U64 allowed = check_mask;
+        if (get_bit(pinned, source_square)) allowed &= line_squares[king_square][source_square];
+
+        // Pushes -> promotions are noisy, the rest are quiet
+        int target_square = source_square + push;
+        if (!get_bit(occupancy, target_square)) {
+            int promotion = (target_square <= h8 || target_square >= a1);
+            if (get_bit(allowed, target_square) && (gen_type == gen_all || (gen_type == gen_noisy) == promotion)) {
+                add_pawn_moves(move_list, source_square, target_square, offset + P, 0);
+            }
+            if (gen_type != gen_noisy && get_bit(start_rank, source_square) && !get_bit(occupancy, target_square + push) &&
+                get_bit(allowed, target_square + push)) {
+                add_move(move_list, encode_move(source_square, target_square + push, offset + P, 0, 0, 1, 0, 0));
+            }
+        }
+
+        // Quiet moves only -> no captures
+        if (gen_type == gen_quiet) {
+            pop_bit(bitboard, source_square);
+            continue;
+        }
+
+        // Captures
+        attacks = pawn_attacks[side][source_square] & enemies & allowed;
+        while (attacks) {
+            target_square = get_ls1b_index(attacks);
+            add_pawn_moves(move_list, source_square, target_square, offset + P, 1);
+            pop_bit(attacks, target_square);
+        }
+
+        // En passant -> has to capture the checker or block the check, & can't leave the king open to a slider
+        if (pos->enpassant != no_sq && get_bit(pawn_attacks[side][source_square], pos->enpassant)) {
+            U64 captured = 1ULL << (pos->enpassant - push);
+            if (check_mask & ((1ULL << pos->enpassant) | captured)) {
+                U64 occupancy_after = (occupancy ^ (1ULL << source_square) ^ captured) | (1ULL << pos->enpassant);
+                if (!(get_bishop_attacks(king_square, occupancy_after, backend) & enemy_diagonal) &&
+                    !(get_rook_attacks(king_square, occupancy_after, backend) & enemy_orthogonal)) {
+                    add_move(move_list, encode_move(source_square, pos->enpassant, offset + P, 0, 1, 0, 1, 0));
+                }
+            }
+        }
+
+        pop_bit(bitboard, source_square);
+    }
+
+    // Knights -> a pinned knight can never move
+    targets &= check_mask;
+    bitboard = pos->bitboards[offset + N] & ~pinned;
+    while (bitboard) {
+        int source_square = get_ls1b_index(bitboard);
+        attacks = knight_attacks[source_square] & targets;
+        while (attacks) {
+            int target_square = get_ls1b_index(attacks);
+            add_move(move_list, encode_move(source_square, target_square, offset + N, 0, get_bit(enemies, target_square) ? 1 : 0, 0, 0, 0));
+            pop_bit(attacks, target_square);
+        }
+        pop_bit(bitboard, source_square);
+    }
+
+    // Bishops, rooks & queens -> pinned ones can still slide along the pin line
+    for (int piece = offset + B; piece <= offset + Q; piece++) {
+        bitboard = pos->bitboards[piece];
+        while (bitboard) {
+            int source_square = get_ls1b_index(bitboard);
+            if (piece == offset + B) {
+                attacks = get_bishop_attacks(source_square, occupancy, backend);
+            } else if (piece == offset + R) {
+                attacks = get_rook_attacks(source_square, occupancy, backend);
+            } else {
+                attacks = get_queen_attacks(source_square, occupancy, backend);
+            }
+            attacks &= targets;
+            if (get_bit(pinned, source_square)) attacks &= line_squares[king_square][source_square];
+
+            while (attacks) {
+                int target_square = get_ls1b_index(attacks);
+                add_move(move_list, encode_move(source_square, target_square, piece, 0, get_bit(enemies, target_square) ? 1 : 0, 0, 0, 0));
+                pop_bit(attacks, target_square);
+            }
+            pop_bit(bitboard, source_square);
+        }
+    }
+}
+
+// Could the move be played in this position, as generate_legal_moves would encode it? -> for moves that weren't generated
+// here (hash moves, killers & counter moves, which may come from a different position). Checks everything but the king's
+// safety, which is_move_legal takes care of.
+// (Called through is_move_pseudo_legal, which points at the version for the selected slider backend.)
+static inline __attribute__((always_inline)) int is_move_pseudo_legal_backend(position *pos, int move, int backend) {
+    // Parse the move
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = get_move_piece(move);
+    int promoted_piece = get_move_promoted(move);
+    int capture = get_move_capture(move);
+    int double_push = get_move_double(move);
+    int enpass = get_move_enpassant(move);
+    int castling = get_move_castling(move);
+
+    // Sides & piece bitboard offsets
+    int side = pos->side;
+    int offset = (side == white) ? P : p;
+    U64 occupancy = pos->occupancies[both];
+
+    // No move, or not one of our pieces on the source square
+    if (!move || piece < offset || piece > offset + K || !get_bit(pos->bitboards[piece], source_square)) return 0;
+
+    // Can't land on our own pieces, & the capture flag has to match what's on the target square (en passant aside)
+    if (get_bit(pos->occupancies[side], target_square)) return 0;
+    if (!enpass && !capture != !get_bit(pos->occupancies[side ^ 1], target_square)) return 0;
+
+    // Pawn moves
+    if (piece == offset + P) {
+        if (castling) return 0;
+
+        // Promotions -> onto the last rank & into one of our knights to queens
+        int last_rank = (target_square <= h8 || target_square >= a1);
+        if (last_rank != (promoted_piece != 0)) return 0;
+        if (promoted_piece && (promoted_piece < offset + N || promoted_piece > offset + Q)) return 0;
+
+        int push = (side == white) ? -8 : 8;
+        if (enpass) {
+            return capture && !double_push && target_square == pos->enpassant && get_bit(pawn_attacks[side][source_square], target_square);
+        }
+        if (double_push) {
+            U64 start_rank = (side == white) ? 0x00ff000000000000ULL : 0x000000000000ff00ULL;
+            return get_bit(start_rank, source_square) && target_square == source_square + 2 * push &&
+                   !get_bit(occupancy, source_square + push) && !get_bit(occupancy, target_square);
+        }
+        if (capture) {
+            return get_bit(pawn_attacks[side][source_square], target_square) ? 1 : 0;
+        }
+        return target_square == source_square + push && !get_bit(occupancy, target_square);
+    }
+
+    // Pawn flags on a piece move
+    if (promoted_piece || double_push || enpass) return 0;
+
+    // Castling -> the right is still there, the squares in between are empty & the king doesn't start on or cross an
+    // attacked square (the square it lands on is is_move_legal's job)
+    if (castling) {
+        if (capture) return 0;
+        if (side == white) {
+            if (piece == K && source_square == e1 && target_square == g1) {
+                return (pos->castle & wk) && !(occupancy & ((1ULL << f1) | (1ULL << g1))) &&
+                       !is_square_attacked_backend(pos, e1, black, backend) && !is_square_attacked_backend(pos, f1, black, backend);
+            }
+            if (piece == K && source_square == e1 && target_square == c1) {
+                return (pos->castle & wq) && !(occupancy & ((1ULL << d1) | (1ULL << c1) | (1ULL << b1))) &&
+                       !is_square_attacked_backend(pos, e1, black, backend) && !is_square_attacked_backend(pos, d1, black, backend);
+            }
+        } else {
+            if (piece == k && source_square == e8 && target_square == g8) {
+                return (pos->castle & bk) && !(occupancy & ((1ULL << f8) | (1ULL << g8))) &&
+                       !is_square_attacked_backend(pos, e8, white, backend) && !is_square_attacked_backend(pos, f8, white, backend);
+            }
+            if (piece == k && source_square == e8 && target_square == c8) {
+                return (pos->castle & bq) && !(occupancy & ((1ULL << d8) | (1ULL << c8) | (1ULL << b8))) &&
+                       !is_square_attacked_backend(pos, e8, white, backend) && !is_square_attacked_backend(pos, d8, white, backend);
+            }
+        }
+        return 0;
+    }
+
+    // The piece has to attack the target square
+    U64 attacks;
+    switch (piece - offset) {
+        case N: attacks = knight_attacks[source_square]; break;
+        case B: attacks = get_bishop_attacks(source_square, occupancy, backend); break;
+        case R: attacks = get_rook_attacks(source_square, occupancy, backend); break;
+        case Q: attacks = get_queen_attacks(source_square, occupancy, backend); break;
+        default: attacks = king_attacks[source_square]; break;
+    }
+
+    return get_bit(attacks, target_square) ? 1 : 0;
+}
+
+/******************************************\
+===========================================
+
+        Static Exchange Evaluation
+
+===========================================
+\******************************************/
+
+/*
+    SEE -> what a capture wins or loses once every capture & recapture on the target square has been played out, each
+    side always taking with its least valuable attacker & free to stop whenever going on would lose material.
+
+    Swap list: gain[depth] is the material the side making the depth'th recapture has won so far if its capturing piece
+    gets taken back. The list is built forwards (attackers_to once, then only the sliders looked up again after a piece
+    has left the square's lines, to find the x-ray attackers behind it), then folded backwards with the option to stop.
+*/
+
+// SEE piece values [piece] -> the king is worth more than everything else together, so it never captures into a defended square
+const int see_values[12] = {
+    100, 320, 330, 500, 900, 20000,
+    100, 320, 330, 500, 900, 20000
+};
+
+// Static exchange evaluation of a capture (or promotion) for the side to move
+// (Called through see, which points at the version for the selected slider backend.)
+static inline __attribute__((always_inline)) int see_backend(position *pos, int move, int backend) {
+    // Parse the move
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = get_move_piece(move);
+    int promoted_piece = get_move_promoted(move);
+
+    // Swap list & the occupancy as the exchange goes on
+    int gain[32], depth = 0;
+    U64 occupancy = pos->occupancies[both];
+
+    // Value of the captured piece -> the en passant pawn leaves the board right away
+    gain[0] = 0;
+    if (get_move_enpassant(move)) {
+        gain[0] = see_values[P];
+        occupancy ^= 1ULL << (target_square + ((pos->side == white) ? 8 : -8));
+    } else if (get_move_capture(move)) {
+        int start_piece = (pos->side == white) ? p : P;
+        for (int bb_piece = start_piece; bb_piece < start_piece + 6; bb_piece++) {
+            if (get_bit(pos->bitboards[bb_piece], target_square)) {
+                gain[0] = see_values[bb_piece];
+                break;
+            }
+        }
+    }
+
+    // A promoting pawn turns into the new piece on the target square
+    if (promoted_piece) {
+        gain[0] += see_values[promoted_piece] - see_values[P];
+        piece = promoted_piece;
+    }
+
+    // Sliders (both sides) that can see through the pieces leaving the square's lines
+    U64 diagonal = pos->bitboards[B] | pos->bitboards[b] | pos->bitboards[Q] | pos->bitboards[q];
+    U64 orthogonal = pos->bitboards[R] | pos->bitboards[r] | pos->bitboards[Q] | pos->bitboards[q];
+
+    // Everything attacking the target square
+    U64 attackers = attackers_to(pos, target_square, occupancy, backend);
+    U64 source = 1ULL << source_square;
+    int side = pos->side;
+
+    do {
+        // Next recapture -> takes the piece that just captured
+        depth++;
+        gain[depth] = see_values[piece] - gain[depth - 1];
+
+        // Neither side can do better by going on
+        if (((-gain[depth - 1] > gain[depth]) ? -gain[depth - 1] : gain[depth]) < 0) break;
+
+        // Take the capturing piece off the board & look for x-ray attackers behind it
+        occupancy ^= source;
+        attackers |= (get_bishop_attacks(target_square, occupancy, backend) & diagonal)
+                   | (get_rook_attacks(target_square, occupancy, backend) & orthogonal);
+        attackers &= occupancy;
+
+        // Least valuable attacker of the other side
+        side ^= 1;
+        source = 0ULL;
+        int offset = (side == white) ? P : p;
+        for (int bb_piece = offset; bb_piece <= offset + K; bb_piece++) {
+            U64 candidates = attackers & pos->bitboards[bb_piece];
+            if (candidates) {
+                source = candidates & -candidates;
+                piece = bb_piece;
+                break;
+            }
+        }
+    } while (source);
+
+    // Fold the swap list back -> every side takes the better of stopping & going on
+    while (--depth) {
+        gain[depth - 1] = -((-gain[depth - 1] > gain[depth]) ? -gain[depth - 1] : gain[depth]);
+    }
+
+    return gain[0];
+}
+
+/******************************************\
+===========================================
+
+            Slider Backends
+
+===========================================
+\******************************************/
+
+/*
+    Two ways of looking up slider attacks:
+
+    -> Magic (works on every x86-64): mask the occupancy, multiply by the square's magic number & shift -> index
+    -> PEXT (BMI2, Haswell & later): pext gathers the occupancy bits under the mask straight into the index, so there's no
+       magic number to load & no multiply (it's microcoded & slow on AMD before Zen 3 though, so that gets magic by default)
+
+    The backend is picked once at startup with cpuid. Branching on it in every lookup would cost us in the hottest loops,
+    so move generation (pseudo-legal & legal), make_move, is_move_legal, is_move_pseudo_legal, see & is_square_attacked
+    each get compiled twice (the *_backend functions are always inlined with the backend as a constant), & the rest of
+    the engine calls them through function pointers that point at the selected versions.
+*/
+
+// Magic versions
+int is_square_attacked_magic(position *pos, int square, int side) { return is_square_attacked_backend(pos, square, side, slider_magic); }
+void generate_moves_magic(position *pos, moves *move_list) { generate_moves_backend(pos, move_list, slider_magic); }
+int make_move_magic(position *pos, int move, int move_flag) { return make_move_backend(pos, move, move_flag, slider_magic); }
+int is_move_legal_magic(position *pos, int move) { return is_move_legal_backend(pos, move, slider_magic); }
+void generate_legal_moves_magic(position *pos, moves *move_list) { generate_legal_moves_backend(pos, move_list, slider_magic, gen_all); }
+void generate_legal_noisy_magic(position *pos, moves *move_list) { generate_legal_moves_backend(pos, move_list, slider_magic, gen_noisy); }
+void generate_legal_quiets_magic(position *pos, moves *move_list) { generate_legal_moves_backend(pos, move_list, slider_magic, gen_quiet); }
+int is_move_pseudo_legal_magic(position *pos, int move) { return is_move_pseudo_legal_backend(pos, move, slider_magic); }
+int see_magic(position *pos, int move) { return see_backend(pos, move, slider_magic); }
+
+// PEXT versions
+int is_square_attacked_pext(position *pos, int square, int side) { return is_square_attacked_backend(pos, square, side, slider_pext); }
+void generate_moves_pext(position *pos, moves *move_list) { generate_moves_backend(pos, move_list, slider_pext); }
+int make_move_pext(position *pos, int move, int move_flag) { return make_move_backend(pos, move, move_flag, slider_pext); }
+int is_move_legal_pext(position *pos, int move) { return is_move_legal_backend(pos, move, slider_pext); }
+void generate_legal_moves_pext(position *pos, moves *move_list) { generate_legal_moves_backend(pos, move_list, slider_pext, gen_all); }
+void generate_legal_noisy_pext(position *pos, moves *move_list) { generate_legal_moves_backend(pos, move_list, slider_pext, gen_noisy); }
+void generate_legal_quiets_pext(position *pos, moves *move_list) { generate_legal_moves_backend(pos, move_list, slider_pext, gen_quiet); }
+int is_move_pseudo_legal_pext(position *pos, int move) { return is_move_pseudo_legal_backend(pos, move, slider_pext); }
+int see_pext(position *pos, int move) { return see_backend(pos, move, slider_pext); }
+
+// The versions the engine calls -> magic until set_slider_backend() says otherwise
+int (*is_square_attacked)(position *pos, int square, int side) = is_square_attacked_magic;
+void (*generate_moves)(position *pos, moves *move_list) = generate_moves_magic;
+int (*make_move)(position *pos, int move, int move_flag) = make_move_magic;
+int (*is_move_legal)(position *pos, int move) = is_move_legal_magic;
+void (*generate_legal_moves)(position *pos, moves *move_list) = generate_legal_moves_magic;
+void (*generate_legal_noisy)(position *pos, moves *move_list) = generate_legal_noisy_magic;
+void (*generate_legal_quiets)(position *pos, moves *move_list) = generate_legal_quiets_magic;
+int (*is_move_pseudo_legal)(position *pos, int move) = is_move_pseudo_legal_magic;
+int (*see)(position *pos, int move) = see_magic;
+
+// Selected backend
+int slider_backend = slider_magic;
+const char *slider_backend_names[] = { "magic", "pext" };
+
+// Does the CPU have BMI2 (pext)?
+int cpu_has_bmi2() {
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_cpu_supports("bmi2");
+#else
+    return 0;
+#endif
+}
+
+#ifndef GENERATED_TABLES
+
+// Fill the PEXT table -> set_occupancy spreads the index over the mask the same way pext packs it back, so slot
+// [offset + index] holds the attacks for set_occupancy(index). Copied out of the magic lookups, so it's quick.
+void init_pext_attacks() {
+    int table_offset = 0;
+    for (int square = 0; square < 64; square++) {
+        bishop_pext_offset[square] = table_offset;
+        for (int index = 0; index < (1 << bishop_relevant_occ_bits[square]); index++) {
+            U64 occupancy = set_occupancy(index, bishop_relevant_occ_bits[square], bishop_masks[square]);
+            pext_attacks[table_offset + index] = get_bishop_attacks(square, occupancy, slider_magic);
+        }
+        table_offset += 1 << bishop_relevant_occ_bits[square];
+
+        rook_pext_offset[square] = table_offset;
+        for (int index = 0; index < (1 << rook_relevant_occ_bits[square]); index++) {
+            U64 occupancy = set_occupancy(index, rook_relevant_occ_bits[square], rook_masks[square]);
+            pext_attacks[table_offset + index] = get_rook_attacks(square, occupancy, slider_magic);
+        }
+        table_offset += 1 << rook_relevant_occ_bits[square];
+    }
+}
+
+#endif
+
+// Should PEXT be the default? -> only if the CPU has BMI2 & runs pext in hardware (AMD before Zen 3, i.e. family 19h,
+// microcodes it at hundreds of cycles for a full mask, which makes it far slower than a magic multiply)
+int cpu_prefers_pext() {
+    if (!cpu_has_bmi2()) return 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    // Vendor string comes back in ebx, edx, ecx order
+    unsigned int eax, ebx, ecx, edx;
+    char vendor[13];
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) return 0;
+    memcpy(vendor, &ebx, 4);
+    memcpy(vendor + 4, &edx, 4);
+    memcpy(vendor + 8, &ecx, 4);
+    vendor[12] = '\0';
+
+    // AMD (& Hygon, which is Zen 1 underneath) -> family is base family + extended family
+    if (!strcmp(vendor, "AuthenticAMD") || !strcmp(vendor, "HygonGenuine")) {
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+        int family = (eax >> 8) & 0xf;
+        if (family == 0xf) family += (eax >> 20) & 0xff;
+        return family >= 0x19;
+    }
+#endif
+
+    return 1;
+}
+
+// Switch slider backends -> returns 0 if the CPU can't run the one asked for (the current one stays)
+int set_slider_backend(int backend) {
+    if (backend == slider_pext) {
+        if (!cpu_has_bmi2()) return 0;
+
+#ifndef GENERATED_TABLES
+        // Build the PEXT table the first time it's needed
+        static int pext_ready = 0;
+        if (!pext_ready) {
+            init_pext_attacks();
+            pext_ready = 1;
+        }
+#endif
+
+        is_square_attacked = is_square_attacked_pext;
+        generate_moves = generate_moves_pext;
+        make_move = make_move_pext;
+        is_move_legal = is_move_legal_pext;
+        generate_legal_moves = generate_legal_moves_pext;
+        generate_legal_noisy = generate_legal_noisy_pext;
+        generate_legal_quiets = generate_legal_quiets_pext;
+        is_move_pseudo_legal = is_move_pseudo_legal_pext;
+        see = see_pext;
+    } else {
+        is_square_attacked = is_square_attacked_magic;
+        generate_moves = generate_moves_magic;
+        make_move = make_move_magic;
+        is_move_legal = is_move_legal_magic;
+        generate_legal_moves = generate_legal_moves_magic;
+        generate_legal_noisy = generate_legal_noisy_magic;
+        generate_legal_quiets = generate_legal_quiets_magic;
+        is_move_pseudo_legal = is_move_pseudo_legal_magic;
+        see = see_magic;
+    }
+
+    slider_backend = backend;
+    return 1;
+}
+
+/******************************************\
+===========================================
+
+                Perft
+
+===========================================
+\******************************************/
+
+// Get the time in milliseconds
+long long get_time_ms() {
+    #ifdef _WIN64
+        return GetTickCount();
+    #else
+        struct timeval time_value;
+        gettimeofday(&time_value, NULL);
+        return time_value.tv_sec * 1000LL + time_value.tv_usec / 1000;
+    #endif
+}
+
+// Perft driver -> walks the move tree down to the given depth & returns the number of leaf nodes
+static inline U64 perft_driver(position *pos, int depth) {
+    // Reached the leaves -> count the node
+    if (depth == 0) {
+        return 1;
+    }
+
+    // Leaf nodes counter
+    U64 nodes = 0;
+
+    // Generate the moves (move list lives on the stack)
+    moves move_list[1];
+    generate_moves(pos, move_list);
+
+    // Loop over the generated moves
+    for (int move_count = 0; move_count < move_list->count; move_count++) {
+        // Make the move -> skip the illegal ones
+        if (!make_move(pos, move_list->moves[move_count], all_moves)) {
+            continue;
+        }
+
+        // Call the perft driver recursively
+        nodes += perft_driver(pos, depth - 1);
+
+        // Take the move back
+        take_back(pos);
+    }
+
+    return nodes;
+}
+
+/*
+    Perft hash table -> remembers the node count below (position, depth) pairs, so transpositions inside the tree are only
+    counted once. Optional: it only gets used once perft_hash_init() has been called.
+
+    Every entry packs the depth into the low 8 bits of the node count, so an entry is just two 64-bit words. The key is
+    stored XORed with the data, so an entry torn by two threads writing at once simply fails the key check (lockless).
+*/
+typedef struct {
+    U64 key;
+    U64 data; // nodes << 8 | depth
+} perft_hash_entry;
+
+// Perft hash table & its index mask (the number of entries is always a power of 2)
+perft_hash_entry *perft_hash_table = NULL;
+U64 perft_hash_mask;
+
+// Allocate the perft hash table -> uses the largest power of 2 number of entries that fits in the given size
+void perft_hash_init(int megabytes) {
+    // Free the previous table
+    free(perft_hash_table);
+    perft_hash_table = NULL;
+
+    // Hashing turned off
+    if (megabytes <= 0) {
+        return;
+    }
+
+    // Round the number of entries down to a power of 2
+    U64 entries = 1;
+    while (entries * 2 * sizeof(perft_hash_entry) <= (U64)megabytes * 1024 * 1024) {
+        entries *= 2;
+    }
+
+    // Allocate the table
+    perft_hash_table = calloc(entries, sizeof(perft_hash_entry));
+    if (perft_hash_table == NULL) {
+        printf("    Couldn't allocate the perft hash table, counting without it\n");
+        return;
+    }
+    perft_hash_mask = entries - 1;
+}
+
+// Clear the perft hash table -> entries are only valid for one position set up
+void perft_hash_clear() {
+    if (perft_hash_table != NULL) {
+        memset(perft_hash_table, 0, (perft_hash_mask + 1) * sizeof(perft_hash_entry));
+    }
+}
+
+// Move generators perft can count with
+enum { movegen_pseudo_legal, movegen_legal };
+const char *movegen_names[] = { "pseudo-legal", "legal" };
+
+// Move generator the bulk-counting perft uses
+int perft_movegen = movegen_legal;
+
+// Bulk-counting perft, one copy per slider backend & move generator (see perft_bulk)
+U64 perft_bulk_magic(position *pos, int depth);
+U64 perft_bulk_pext(position *pos, int depth);
+U64 perft_legal_magic(position *pos, int depth);
+U64 perft_legal_pext(position *pos, int depth);
+
+// Bulk-counting perft -> at depth 1 the legal moves are counted instead of made (is_move_legal doesn't touch the board),
+// and with the perft hash table on, subtrees that were already counted get looked up instead of walked again.
+// With the legal move generator, the leaves are simply the size of the move list & no move needs a king check.
+// This is the hot loop the slider backends get benchmarked with, so it's compiled once per backend (& move generator)
+// & calls the move generator directly instead of through the function pointers.
+static inline __attribute__((always_inline)) U64 perft_bulk_backend(position *pos, int depth, int backend, int movegen) {
+    // Generate the moves (move list lives on the stack)
+    moves move_list[1];
+    if (movegen == movegen_legal) {
+        if (backend == slider_pext) {
+            generate_legal_moves_pext(pos, move_list);
+        } else {
+            generate_legal_moves_magic(pos, move_list);
+        }
+    } else if (backend == slider_pext) {
+        generate_moves_pext(pos, move_list);
+    } else {
+        generate_moves_magic(pos, move_list);
+    }
+
+    // Leaves -> count the legal moves
+    if (depth == 1 && movegen == movegen_legal) {
+        return move_list->count;
+    }
+    if (depth == 1) {
+        U64 leaves = 0;
+        for (int move_count = 0; move_count < move_list->count; move_count++) {
+            leaves += is_move_legal_backend(pos, move_list->moves[move_count], backend);
+        }
+        return leaves;
+    }
+
+    // Probe the perft hash table
+    U64 key = 0;
+    perft_hash_entry *entry = NULL;
+    if (perft_hash_table != NULL) {
+        key = pos->hash_key;
+        entry = &perft_hash_table[key & perft_hash_mask];
+        U64 data = entry->data;
+        if ((entry->key ^ data) == key && (data & 0xff) == (U64)depth) {
+            return data >> 8;
+        }
+    }
+
+    // Count the nodes below every legal move
+    U64 count = 0;
+    for (int move_count = 0; move_count < move_list->count; move_count++) {
+        // Make the move -> skip the illegal ones
+        if (!make_move_backend(pos, move_list->moves[move_count], (movegen == movegen_legal) ? legal_move : all_moves, backend)) {
+            continue;
+        }
+
+        if (movegen == movegen_legal) {
+            count += (backend == slider_pext) ? perft_legal_pext(pos, depth - 1) : perft_legal_magic(pos, depth - 1);
+        } else {
+            count += (backend == slider_pext) ? perft_bulk_pext(pos, depth - 1) : perft_bulk_magic(pos, depth - 1);
+        }
+
+        // Take the move back
+        take_back(pos);
+    }
+
+    // Store the node count (always replace)
+    if (entry != NULL) {
+        U64 data = (count << 8) | depth;
+        entry->key = key ^ data;
+        entry->data = data;
+    }
+
+    return count;
+}
+
+U64 perft_bulk_magic(position *pos, int depth) { return perft_bulk_backend(pos, depth, slider_magic, movegen_pseudo_legal); }
+U64 perft_bulk_pext(position *pos, int depth) { return perft_bulk_backend(pos, depth, slider_pext, movegen_pseudo_legal); }
+U64 perft_legal_magic(position *pos, int depth) { return perft_bulk_backend(pos, depth, slider_magic, movegen_legal); }
+U64 perft_legal_pext(position *pos, int depth) { return perft_bulk_backend(pos, depth, slider_pext, movegen_legal); }
+
+// Bulk-counting perft with the selected slider backend & move generator
+U64 perft_bulk(position *pos, int depth) {
+    if (perft_movegen == movegen_legal) {
+        return (slider_backend == slider_pext) ? perft_legal_pext(pos, depth) : perft_legal_magic(pos, depth);
+    }
+    return (slider_backend == slider_pext) ? perft_bulk_pext(pos, depth) : perft_bulk_magic(pos, depth);
+}
+
+/*
+    Parallel perft -> the tree gets split into depth-2 subtrees (every legal root move + every legal reply), which are handed
+    out to a pool of worker threads. Every worker owns a copy of the root position & a queue of subtrees: it works through
+    its own queue from the front, and once that runs dry it steals subtrees from the back of the fullest queue of the others.
+    Node counts are written per subtree and summed up after all the workers are done, so there's nothing to synchronize
+    apart from the queues themselves (and the perft hash table, which is lockless).
+*/
+
+// Maximum number of worker threads
+#define MAX_THREADS 256
+
+// Parallel perft task -> a subtree below the root
+typedef struct {
+    int root_move;
+    int reply; // 0 when the tree is only split at the root
+    U64 nodes;
+} perft_task;
+
+// Task queue -> a range of the task array, the owner pops from the front & thieves steal from the back
+typedef struct {
+    pthread_mutex_t lock;
+    int front;
+    int back;
+} perft_queue;
+
+struct perft_pool;
+
+// Worker thread -> own position copy & task queue
+typedef struct {
+    pthread_t thread;
+    int id;
+    struct perft_pool *pool;
+    perft_queue queue;
+    position pos;
+} perft_worker;
+
+// Shared parallel perft state
+typedef struct perft_pool {
+    perft_task *tasks;
+    perft_worker *workers;
+    int worker_count;
+    int depth; // depth left below every task
+} perft_pool;
+
+// Pop a task from the front of the worker's own queue -> -1 if it's empty
+static int perft_pop_task(perft_queue *queue) {
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->front < queue->back) {
+        task = queue->front++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+// Steal a task from the back of the fullest queue of the other workers -> -1 if there's nothing left anywhere
+static int perft_steal_task(perft_pool *pool, int thief) {
+    while (1) {
+        // Find the victim with the most tasks left
+        int victim = -1, most = 0;
+        for (int worker = 0; worker < pool->worker_count; worker++) {
+            perft_queue *queue = &pool->workers[worker].queue;
+            pthread_mutex_lock(&queue->lock);
+            int left = queue->back - queue->front;
+            pthread_mutex_unlock(&queue->lock);
+            if (worker != thief && left > most) {
+                victim = worker;
+                most = left;
+            }
+        }
+
+        // Every queue is empty -> tasks are never added after the start, so we're done
+        if (victim < 0) {
+            return -1;
+        }
+
+        // Take the task at the back of the victim's queue
+        perft_queue *queue = &pool->workers[victim].queue;
+        int task = -1;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->front < queue->back) {
+            task = --queue->back;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        // Somebody else got there first -> look again
+        if (task >= 0) {
+            return task;
+        }
+    }
+}
+
+// Worker thread loop -> count subtrees until there are none left to pop or steal
+static void *perft_worker_loop(void *argument) {
+    perft_worker *worker = argument;
+    perft_pool *pool = worker->pool;
+
+    while (1) {
+        // Own queue first, then steal
+        int task = perft_pop_task(&worker->queue);
+        if (task < 0) {
+            task = perft_steal_task(pool, worker->id);
+        }
+        if (task < 0) {
+            break;
+        }
+
+        // Play down to the subtree on our own position copy (the moves are legal, they were checked while splitting)
+        make_move(&worker->pos, pool->tasks[task].root_move, all_moves);
+        if (pool->tasks[task].reply) {
+            make_move(&worker->pos, pool->tasks[task].reply, all_moves);
+        }
+
+        // Count the subtree
+        pool->tasks[task].nodes = pool->depth ? perft_bulk(&worker->pos, pool->depth) : 1;
+
+        // Back to the root
+        if (pool->tasks[task].reply) {
+            take_back(&worker->pos);
+        }
+        take_back(&worker->pos);
+    }
+
+    return NULL;
+}
+
+// Get the number of logical processors
+int get_cpu_count() {
+    #ifdef _WIN64
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        return system_info.dwNumberOfProcessors;
+    #else
+        return (int)sysconf(_SC_NPROCESSORS_ONLN);
+    #endif
+}
+
+// Parallel bulk-counting perft -> same node count as perft_bulk, spread over the given number of threads (0 = all cores).
+// With divide set, the node count below every root move gets printed too.
+U64 perft_parallel(position *pos, int depth, int threads, int divide) {
+    // Clamp the number of threads
+    if (threads <= 0) threads = get_cpu_count();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    // Nothing worth splitting
+    if (depth < 2) {
+        return perft_bulk(pos, depth);
+    }
+
+    // Split at depth 2 when the tree is deep enough, at the root otherwise
+    int split_depth = (depth >= 3) ? 2 : 1;
+
+    // Build the task list
+    perft_task *tasks = malloc(sizeof(perft_task) * MAX_MOVES * MAX_MOVES);
+    perft_worker *workers = aligned_calloc(threads, sizeof(perft_worker));
+    if (tasks == NULL || workers == NULL) {
+        // Out of memory -> count the whole tree on this thread instead
+        free(tasks);
+        aligned_free(workers);
+        return perft_bulk(pos, depth);
+    }
+    int task_count = 0;
+
+    moves root_moves[1];
+    generate_moves(pos, root_moves);
+    for (int root_count = 0; root_count < root_moves->count; root_count++) {
+        int root_move = root_moves->moves[root_count];
+        if (!make_move(pos, root_move, all_moves)) {
+            continue;
+        }
+
+        if (split_depth == 1) {
+            tasks[task_count++] = (perft_task){ root_move, 0, 0 };
+        } else {
+            moves replies[1];
+            generate_moves(pos, replies);
+            for (int reply_count = 0; reply_count < replies->count; reply_count++) {
+                if (is_move_legal(pos, replies->moves[reply_count])) {
+                    tasks[task_count++] = (perft_task){ root_move, replies->moves[reply_count], 0 };
+                }
+            }
+        }
+
+        take_back(pos);
+    }
+
+    // Set up the worker pool -> every worker starts with an equal slice of the tasks
+    perft_pool pool = { tasks, workers, threads, depth - split_depth };
+    int slice = (task_count + threads - 1) / threads;
+    for (int id = 0; id < threads; id++) {
+        perft_worker *worker = &pool.workers[id];
+        worker->id = id;
+        worker->pool = &pool;
+        worker->queue.front = (id * slice < task_count) ? id * slice : task_count;
+        worker->queue.back = ((id + 1) * slice < task_count) ? (id + 1) * slice : task_count;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        memcpy(&worker->pos, pos, sizeof(position));
+    }
+
+    // Run the workers & wait for them to finish
+    for (int id = 0; id < threads; id++) {
+        pthread_create(&pool.workers[id].thread, NULL, perft_worker_loop, &pool.workers[id]);
+    }
+    for (int id = 0; id < threads; id++) {
+        pthread_join(pool.workers[id].thread, NULL);
+        pthread_mutex_destroy(&pool.workers[id].queue.lock);
+    }
+
+    // Sum up the node counts (tasks of the same root move are next to each other)
+    U64 total = 0;
+    for (int task = 0; task < task_count; task++) {
+        U64 move_nodes = tasks[task].nodes;
+        while (task + 1 < task_count && tasks[task + 1].root_move == tasks[task].root_move) {
+            move_nodes += tasks[++task].nodes;
+        }
+        total += move_nodes;
+
+        if (divide) {
+            printf("    ");
+            print_move(tasks[task].root_move);
+            printf(": %llu\n", move_nodes);
+        }
+    }
+
+    aligned_free(pool.workers);
+    free(tasks);
+    return total;
+}
+
+// Perft divide -> prints the node count below every root move (handy for tracking down move generator bugs against a reference engine)
+void perft_divide(position *pos, int depth) {
+    printf("\n    Performance test (divide)\n\n");
+
+    // Leaf nodes counter
+    U64 nodes = 0;
+
+    // Start the timer
+    long long start = get_time_ms();
+
+    // Generate the root moves
+    moves move_list[1];
+    generate_moves(pos, move_list);
+
+    // Loop over the root moves
+    for (int move_count = 0; move_count < move_list->count; move_count++) {
+        int move = move_list->moves[move_count];
+
+        // Make the move -> skip the illegal ones
+        if (!make_move(pos, move, all_moves)) {
+            continue;
+        }
+
+        // Count the nodes below the current root move
+        U64 move_nodes = (depth > 1) ? perft_bulk(pos, depth - 1) : 1;
+        nodes += move_nodes;
+
+        // Take the move back
+        take_back(pos);
+
+        // Print the root move & its node count
+        printf("    ");
+        print_move(move);
+        printf(": %llu\n", move_nodes);
+    }
+
+    // Print the results
+    long long elapsed = get_time_ms() - start;
+    printf("\n    Depth: %d\n", depth);
+    printf("    Nodes: %llu\n", nodes);
+    printf("     Time: %lld ms\n", elapsed);
+    printf("      NPS: %llu\n\n", elapsed ? nodes * 1000 / elapsed : 0);
+}
+
+// Maximum depth of the known node counts below
+#define PERFT_MAX_DEPTH 8
+
+// Perft suite entry -> a debug position & its known node counts (index 0 = depth 1, 0 = unknown)
+typedef struct {
+    char *name;
+    char *fen;
+    U64 nodes[PERFT_MAX_DEPTH];
+} perft_entry;
+
+// Known node counts for the debug positions
+perft_entry perft_suite[] = {
+    { "start",  start_position,  { 20, 400, 8902, 197281, 4865609, 119060324, 3195901860ULL, 84998978956ULL } },
+    { "tricky", tricky_position, { 48, 2039, 97862, 4085603, 193690690, 8031647685ULL } },
+    { "killer", killer_position, { 42, 1088, 39518, 1032012, 36112837 } },
+    { "cmk",    cmk_position,    { 43, 1289, 54240, 1679340, 69838845 } },
+};
+
+// Perft counting modes
+enum { perft_plain, perft_bulk_count };
+
+// Run perft over all the debug positions & check the node counts -> returns the number of mismatches
+// Plain mode makes every leaf move (measures make/take back), bulk mode uses perft_bulk (and the perft hash table if it's on),
+// spread over the given number of threads.
+int perft_test_suite(position *pos, int depth, int mode, int threads) {
+    // Clamp the depth to the known node counts
+    if (depth < 1) depth = 1;
+    if (depth > PERFT_MAX_DEPTH) depth = PERFT_MAX_DEPTH;
+
+    printf("\n    Performance test suite (depth %d, %s%s, %d thread%s, %s sliders, %s moves)\n\n", depth, (mode == perft_plain) ? "plain" : "bulk counting",
+           (mode == perft_bulk_count && perft_hash_table != NULL) ? " + hash" : "",
+           (mode == perft_plain) ? 1 : threads, ((mode == perft_plain) || threads == 1) ? "" : "s", slider_backend_names[slider_backend],
+           (mode == perft_plain) ? movegen_names[movegen_pseudo_legal] : movegen_names[perft_movegen]);
+
+    // Mismatching node counts & total nodes/time over the whole suite
+    int failures = 0;
+    U64 total_nodes = 0;
+    long long total_time = 0;
+
+    // Loop over the suite entries
+    for (int entry = 0; entry < (int)(sizeof(perft_suite) / sizeof(perft_suite[0])); entry++) {
+        // Known node count at this depth
+        U64 expected = perft_suite[entry].nodes[depth - 1];
+
+        // Set up the position
+        parse_fen(pos, perft_suite[entry].fen);
+        perft_hash_clear();
+
+        // Start the timer
+        long long start = get_time_ms();
+
+        // Count the leaf nodes
+        U64 nodes;
+        if (mode == perft_plain) {
+            nodes = perft_driver(pos, depth);
+        } else if (threads > 1) {
+            nodes = perft_parallel(pos, depth, threads, 0);
+        } else {
+            nodes = perft_bulk(pos, depth);
+        }
+
+        // Stop the timer
+        long long elapsed = get_time_ms() - start;
+        total_nodes += nodes;
+        total_time += elapsed;
+
+        // Compare against the known node count (if there is one)
+        int pass = (nodes == expected);
+        if (expected && !pass) {
+            failures++;
+        }
+
+        printf("    %-8s %s  nodes: %12llu  expected: %12llu  time: %6lld ms  nps: %llu\n",
+               perft_suite[entry].name, !expected ? "----" : (pass ? "PASS" : "FAIL"), nodes, expected,
+               elapsed, elapsed ? nodes * 1000 / elapsed : 0);
+    }
+
+    // Print the totals
+    printf("\n    Total nodes: %llu  time: %lld ms  nps: %llu\n", total_nodes, total_time,
+           total_time ? total_nodes * 1000 / total_time : 0);
+    printf("    %s\n\n", failures ? "Perft suite FAILED" : "Perft suite passed");
+
+    return failures;
+}
+
+/*
+    Slider table benchmark -> looks the same random (square, occupancy) pairs up in the back to back slider table & in the
+    shared-entry one (see build_shared_slider_table), once as independent lookups (throughput) & once as a chain where every
+    lookup picks the next pair from the last result (latency, so cache misses show up in full).
+    On Linux the hardware cache-miss counter is read too (when the kernel lets us).
+*/
+
+// Number of random lookup pairs
+#define SLIDER_BENCH_SAMPLES 65536
+
+// Both slider table layouts
+typedef struct {
+    U64 *attacks;                   // back to back -> attack sets
+    unsigned short *references;     // shared entry -> references into attack_sets
+    U64 *attack_sets;
+} slider_bench_tables;
+
+// Cache-miss counter -> returns a file descriptor (or -1 if there's no counter to read)
+int cache_miss_counter_open() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+// Read the cache-miss counter -> -1 if there isn't one
+long long cache_miss_counter_read(int counter) {
+    long long misses = -1;
+#ifdef __linux__
+    if (counter >= 0 && read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+        misses = -1;
+    }
+#endif
+    return misses;
+}
+
+// Slot of a queen's bishop & rook attacks in the slider table
+static inline void bench_queen_slots(int square, U64 occupancy, int *bishop_slot, int *rook_slot) {
+    *bishop_slot = bishop_offset[square] + (int)(((occupancy & bishop_masks[square]) * bishop_magic_numbers[square]) >> (64 - bishop_magic_bits[square]));
+    *rook_slot = rook_offset[square] + (int)(((occupancy & rook_masks[square]) * rook_magic_numbers[square]) >> (64 - rook_magic_bits[square]));
+}
+
+// Queen attacks out of one of the layouts
+static inline U64 bench_queen_attacks(slider_bench_tables *tables, int shared, int square, U64 occupancy) {
+    int bishop_slot, rook_slot;
+    bench_queen_slots(square, occupancy, &bishop_slot, &rook_slot);
+    if (shared) {
+        return tables->attack_sets[tables->references[bishop_slot]] | tables->attack_sets[tables->references[rook_slot]];
+    }
+    return tables->attacks[bishop_slot] | tables->attacks[rook_slot];
+}
+
+// Time one layout -> independent & dependent lookups
+void slider_bench_run(slider_bench_tables *tables, int shared, long long lookups, int *squares, U64 *occupancies) {
+    // Independent lookups -> throughput
+    int counter = cache_miss_counter_open();
+    long long misses_before = cache_miss_counter_read(counter);
+    long long start = get_time_ms();
+    U64 checksum = 0;
+    for (long long lookup = 0; lookup < lookups; lookup++) {
+        int sample = (int)(lookup & (SLIDER_BENCH_SAMPLES - 1));
+        checksum ^= bench_queen_attacks(tables, shared, squares[sample], occupancies[sample]);
+    }
+    long long throughput_time = get_time_ms() - start;
+    long long throughput_misses = cache_miss_counter_read(counter) - misses_before;
+
+    // Dependent lookups -> every lookup waits on the last one
+    misses_before = cache_miss_counter_read(counter);
+    start = get_time_ms();
+    U64 attacks = 0;
+    for (long long lookup = 0; lookup < lookups; lookup++) {
+        int sample = (int)((lookup + attacks) & (SLIDER_BENCH_SAMPLES - 1));
+        attacks = bench_queen_attacks(tables, shared, squares[sample], occupancies[sample]);
+    }
+    long long latency_time = get_time_ms() - start;
+    long long latency_misses = cache_miss_counter_read(counter) - misses_before;
+    checksum ^= attacks;
+#ifdef __linux__
+    if (counter >= 0) close(counter);
+#endif
+
+    printf("                  throughput: %6lld ms  %5lld M lookups/s", throughput_time,
+           throughput_time ? lookups / throughput_time / 1000 : 0);
+    if (counter >= 0) printf("  cache misses: %lld", throughput_misses);
+    printf("\n                  latency:    %6lld ms  %5lld M lookups/s", latency_time,
+           latency_time ? lookups / latency_time / 1000 : 0);
+    if (counter >= 0) printf("  cache misses: %lld", latency_misses);
+    printf("  (checksum %llx)\n\n", checksum & 0xffff);
+}
+
+// Compare the back to back & shared-entry slider tables -> millions of queen lookups per run
+void slider_benchmark(int millions) {
+    if (millions < 1) millions = 1;
+    long long lookups = (long long)millions * 1000000;
+
+    // Back to back layout -> rebuilt from the engine's own lookups, so it works whatever layout the engine was built with
+    slider_bench_tables tables;
+    tables.attacks = aligned_calloc(SLIDER_TABLE_SIZE, sizeof(U64));
+    tables.references = aligned_calloc(SLIDER_TABLE_SIZE, sizeof(unsigned short));
+    tables.attack_sets = aligned_calloc(SLIDER_SET_COUNT, sizeof(U64));
+    for (int square = 0; square < 64; square++) {
+        int bishop_bits = bishop_relevant_occ_bits[square];
+        for (int index = 0; index < (1 << bishop_bits); index++) {
+            U64 occupancy = set_occupancy(index, bishop_bits, bishop_masks[square]);
+            int magic_index = (int)((occupancy * bishop_magic_numbers[square]) >> (64 - bishop_magic_bits[square]));
+            tables.attacks[bishop_offset[square] + magic_index] = get_bishop_attacks(square, occupancy, slider_magic);
+        }
+        int rook_bits = rook_relevant_occ_bits[square];
+        for (int index = 0; index < (1 << rook_bits); index++) {
+            U64 occupancy = set_occupancy(index, rook_bits, rook_masks[square]);
+            int magic_index = (int)((occupancy * rook_magic_numbers[square]) >> (64 - rook_magic_bits[square]));
+            tables.attacks[rook_offset[square] + magic_index] = get_rook_attacks(square, occupancy, slider_magic);
+        }
+    }
+
+    // Shared-entry layout
+    int set_count = build_shared_slider_table(tables.attacks, bishop_offset, rook_offset, tables.references, tables.attack_sets);
+
+    // Random lookup pairs -> occupancy at ~25% density
+    int *squares = malloc(SLIDER_BENCH_SAMPLES * sizeof(int));
+    U64 *occupancies = malloc(SLIDER_BENCH_SAMPLES * sizeof(U64));
+    for (int sample = 0; sample < SLIDER_BENCH_SAMPLES; sample++) {
+        squares[sample] = get_random_U32_number() % 64;
+        occupancies[sample] = get_random_U64_number() & get_random_U64_number();
+    }
+
+    // Cache lines the random pairs touch in either layout
+    unsigned char *touched = calloc(SLIDER_TABLE_SIZE, 1);
+    int touched_lines[2] = { 0, 0 };
+    for (int sample = 0; sample < SLIDER_BENCH_SAMPLES; sample++) {
+        int slots[2];
+        bench_queen_slots(squares[sample], occupancies[sample], &slots[0], &slots[1]);
+        for (int slot = 0; slot < 2; slot++) {
+            // Back to back -> 8 attack sets per line
+            if (!(touched[slots[slot] / 8] & 1)) {
+                touched[slots[slot] / 8] |= 1;
+                touched_lines[0]++;
+            }
+            // Shared entry -> 32 references per line, plus the line holding the attack set
+            if (!(touched[slots[slot] / 32] & 2)) {
+                touched[slots[slot] / 32] |= 2;
+                touched_lines[1]++;
+            }
+            if (!(touched[tables.references[slots[slot]] / 8] & 4)) {
+                touched[tables.references[slots[slot]] / 8] |= 4;
+                touched_lines[1]++;
+            }
+        }
+    }
+    free(touched);
+
+    printf("\n    Slider table benchmark (%d million queen lookups per run, %d random positions)\n\n", millions, SLIDER_BENCH_SAMPLES);
+
+    printf("    back to back  size: %4d KB  lines touched: %5d\n", (int)(SLIDER_TABLE_SIZE * sizeof(U64) / 1024), touched_lines[0]);
+    slider_bench_run(&tables, 0, lookups, squares, occupancies);
+
+    printf("    shared entry  size: %4d KB  lines touched: %5d  (%d attack sets)\n",
+           (int)((SLIDER_TABLE_SIZE * sizeof(unsigned short) + set_count * sizeof(U64)) / 1024), touched_lines[1], set_count);
+    slider_bench_run(&tables, 1, lookups, squares, occupancies);
+
+    free(squares);
+    free(occupancies);
+    aligned_free(tables.attacks);
+    aligned_free(tables.references);
+    aligned_free(tables.attack_sets);
+}
+
+/*
+    Fill attack benchmark -> both sides' slider attack sets for a batch of positions from random games, once by looking up
+    every slider (get_rook_attacks/get_bishop_attacks, magic backend) & OR-ing them together, & once with each fill
+    attack generator the CPU can run. All of them have to agree.
+*/
+
+// Number of benchmark positions
+#define FILL_BENCH_POSITIONS 4096
+
+// Sliders & occupancy of one benchmark position
+typedef struct {
+    U64 orthogonal[2];
+    U64 diagonal[2];
+    U64 occupancy;
+} fill_bench_position;
+
+// Slider attack sets of both sides by looking every slider up
+static inline void lookup_slider_attacks(const U64 *orthogonal, const U64 *diagonal, U64 occupancy, U64 *attacks) {
+    for (int side = white; side <= black; side++) {
+        attacks[side] = 0ULL;
+        U64 sliders = orthogonal[side];
+        while (sliders) {
+            int square = get_ls1b_index(sliders);
+            attacks[side] |= get_rook_attacks(square, occupancy, slider_magic);
+            pop_bit(sliders, square);
+        }
+        sliders = diagonal[side];
+        while (sliders) {
+            int square = get_ls1b_index(sliders);
+            attacks[side] |= get_bishop_attacks(square, occupancy, slider_magic);
+            pop_bit(sliders, square);
+        }
+    }
+}
+
+// Compare the slider lookups with the fill attack generators -> millions of positions per run
+void fill_benchmark(int millions) {
+    if (millions < 1) millions = 1;
+    long long runs = (long long)millions * 1000000;
+
+    // Positions from random games (restarted from the start position every 100 plies or when a game ends)
+    fill_bench_position *positions = malloc(FILL_BENCH_POSITIONS * sizeof(fill_bench_position));
+    position *pos = create_position();
+    parse_fen(pos, start_position);
+    for (int count = 0, ply = 0; count < FILL_BENCH_POSITIONS; ply++) {
+        moves move_list[1];
+        generate_moves(pos, move_list);
+
+        // Play a random legal move (or start over)
+        int played = 0;
+        for (int attempt = 0; attempt < move_list->count && !played && ply < 100; attempt++) {
+            played = make_move(pos, move_list->moves[get_random_U32_number() % move_list->count], all_moves);
+        }
+        if (!played) {
+            parse_fen(pos, start_position);
+            ply = 0;
+            continue;
+        }
+
+        fill_bench_position *entry = &positions[count++];
+        entry->orthogonal[white] = pos->bitboards[R] | pos->bitboards[Q];
+        entry->orthogonal[black] = pos->bitboards[r] | pos->bitboards[q];
+        entry->diagonal[white] = pos->bitboards[B] | pos->bitboards[Q];
+        entry->diagonal[black] = pos->bitboards[b] | pos->bitboards[q];
+        entry->occupancy = pos->occupancies[both];
+    }
+    destroy_position(pos);
+
+    // Generators to compare
+    char *names[4] = { "lookup", "scalar", "sse2", "avx2" };
+    void (*generators[4])(const U64 *, const U64 *, U64, U64 *) = { NULL, fill_attacks_scalar, NULL, NULL };
+#if defined(__x86_64__)
+    generators[2] = fill_attacks_sse2;
+    if (cpu_has_avx2()) generators[3] = fill_attacks_avx2;
+#endif
+
+    printf("\n    Fill attack benchmark (%d million positions per run, both sides' slider attacks)\n\n", millions);
+
+    for (int generator = 0; generator < 4; generator++) {
+        if (generator && generators[generator] == NULL) {
+            printf("    %-8s not supported on this CPU\n", names[generator]);
+            continue;
+        }
+
+        // Check against the lookups first
+        for (int index = 0; index < FILL_BENCH_POSITIONS && generator; index++) {
+            fill_bench_position *entry = &positions[index];
+            U64 expected[2], attacks[2];
+            lookup_slider_attacks(entry->orthogonal, entry->diagonal, entry->occupancy, expected);
+            generators[generator](entry->orthogonal, entry->diagonal, ~entry->occupancy, attacks);
+            if (attacks[white] != expected[white] || attacks[black] != expected[black]) {
+                printf("    %-8s MISMATCH on position %d\n", names[generator], index);
+                free(positions);
+                return;
+            }
+        }
+
+        // Time it
+        long long start = get_time_ms();
+        U64 checksum = 0;
+        for (long long run = 0; run < runs; run++) {
+            fill_bench_position *entry = &positions[run & (FILL_BENCH_POSITIONS - 1)];
+            U64 attacks[2];
+            if (generator) {
+                generators[generator](entry->orthogonal, entry->diagonal, ~entry->occupancy, attacks);
+            } else {
+                lookup_slider_attacks(entry->orthogonal, entry->diagonal, entry->occupancy, attacks);
+            }
+            checksum += attacks[white] ^ attacks[black];
+        }
+        long long elapsed = get_time_ms() - start;
+
+        printf("    %-8s %6lld ms  %5lld M positions/s  (checksum %llx)%s\n", names[generator], elapsed,
+               elapsed ? runs / elapsed / 1000 : 0, checksum & 0xffff,
+               (generator && generators[generator] == fill_attacks) ? "  <- used by the engine" : "");
+    }
+    printf("\n");
+
+    free(positions);
+}
+
+// SEE benchmark -> static exchange evaluations per second over every capture in the tricky & killer positions
+void see_benchmark(int millions) {
+    if (millions < 1) millions = 1;
+    long long calls = (long long)millions * 1000000;
+
+    char *names[2] = { "tricky", "killer" };
+    char *fens[2] = { tricky_position, killer_position };
+
+    printf("\n    SEE benchmark (%d million calls per position, %s sliders)\n\n", millions, slider_backend_names[slider_backend]);
+
+    position *pos = create_position();
+    for (int entry = 0; entry < 2; entry++) {
+        parse_fen(pos, fens[entry]);
+
+        // The captures to evaluate
+        moves noisy[1], captures[1];
+        generate_legal_noisy(pos, noisy);
+        captures->count = 0;
+        for (int count = 0; count < noisy->count; count++) {
+            if (get_move_capture(noisy->moves[count])) add_move(captures, noisy->moves[count]);
+        }
+
+        // Time it
+        long long start = get_time_ms();
+        long long checksum = 0;
+        int losing = 0;
+        for (long long call = 0; call < calls; call++) {
+            checksum += see(pos, captures->moves[call % captures->count]);
+        }
+        long long elapsed = get_time_ms() - start;
+
+        for (int count = 0; count < captures->count; count++) {
+            if (see(pos, captures->moves[count]) < 0) losing++;
+        }
+
+        printf("    %-8s %2d captures (%2d losing)  %6lld ms  %5lld M calls/s  (checksum %llx)\n", names[entry], captures->count,
+               losing, elapsed, elapsed ? calls / elapsed / 1000 : 0, (U64)checksum & 0xffff);
+    }
+    printf("\n");
+
+    destroy_position(pos);
+}
+
+// FEN benchmark -> FENs parsed & written per second over positions from random games, after checking that every one of
+// them survives the round trip (position_to_fen & back gives the same keys & scores & the same FEN again)
+#define FEN_BENCH_POSITIONS 4096
+#define FEN_BENCH_BOARDS 64
+
+void fen_benchmark(int millions) {
+    if (millions < 1) millions = 1;
+    long long calls = (long long)millions * 1000000;
+
+    char (*fens)[FEN_MAX_LENGTH + 1] = malloc(FEN_BENCH_POSITIONS * sizeof(*fens));
+    int *lengths = malloc(FEN_BENCH_POSITIONS * sizeof(int));
+    position *pos = create_position();
+    position *copy = create_position();
+
+    // Positions from random games (up to 200 plies long), round trip checked
+    int mismatches = 0;
+    long long total_length = 0;
+    parse_fen(pos, start_position);
+    for (int count = 0, ply = 0; count < FEN_BENCH_POSITIONS; ) {
+        moves move_list[1];
+        generate_legal_moves(pos, move_list);
+        if (!move_list->count || ply >= 200) {
+            parse_fen(pos, start_position);
+            ply = 0;
+            continue;
+        }
+        make_move(pos, move_list->moves[get_random_U32_number() % move_list->count], legal_move);
+        ply++;
+
+        char again[FEN_MAX_LENGTH + 1];
+        lengths[count] = position_to_fen(pos, fens[count], sizeof(fens[count]));
+        if (parse_fen_length(copy, fens[count], lengths[count]) != fen_ok || copy->hash_key != pos->hash_key ||
+            copy->pawn_key != pos->pawn_key || copy->psq_score != pos->psq_score || copy->phase != pos->phase ||
+            position_to_fen(copy, again, sizeof(again)) != lengths[count] || strcmp(again, fens[count])) {
+            if (!mismatches++) printf("    Round trip mismatch: %s\n", fens[count]);
+        }
+        total_length += lengths[count];
+        count++;
+    }
+
+    printf("\n    FEN benchmark (%d positions from random games, average %lld characters, %d million calls)\n\n",
+           FEN_BENCH_POSITIONS, total_length / FEN_BENCH_POSITIONS, millions);
+    printf("    round trip  %s (%d mismatches)\n", mismatches ? "FAIL" : "PASS", mismatches);
+
+    // Parse
+    U64 checksum = 0;
+    long long start = get_time_ms();
+    for (long long call = 0; call < calls; call++) {
+        int entry = call & (FEN_BENCH_POSITIONS - 1);
+        parse_fen_length(pos, fens[entry], lengths[entry]);
+        checksum ^= pos->hash_key;
+    }
+    long long elapsed = get_time_ms() - start;
+    printf("    parse       %6lld ms  %6.2f M FENs/s  %7.1f MB/s  (checksum %llx)\n", elapsed,
+           elapsed ? calls / 1000.0 / elapsed : 0.0, elapsed ? calls * (double)total_length / FEN_BENCH_POSITIONS / 1000.0 / elapsed : 0.0,
+           checksum & 0xffff);
+
+    // Write -> a few boards spread over the positions
+    position *boards = aligned_calloc(FEN_BENCH_BOARDS, sizeof(position));
+    for (int board = 0; board < FEN_BENCH_BOARDS; board++) {
+        parse_fen(&boards[board], fens[board * (FEN_BENCH_POSITIONS / FEN_BENCH_BOARDS)]);
+    }
+    checksum = 0;
+    long long written = 0;
+    start = get_time_ms();
+    for (long long call = 0; call < calls; call++) {
+        char fen[FEN_MAX_LENGTH + 1];
+        int length = position_to_fen(&boards[call & (FEN_BENCH_BOARDS - 1)], fen, sizeof(fen));
+        written += length;
+        checksum += fen[call % length];
+    }
+    elapsed = get_time_ms() - start;
+    printf("    write       %6lld ms  %6.2f M FENs/s  %7.1f MB/s  (checksum %llx)\n\n", elapsed,
+           elapsed ? calls / 1000.0 / elapsed : 0.0, elapsed ? written / 1000.0 / elapsed : 0.0, checksum & 0xffff);
+
+    aligned_free(boards);
+    destroy_position(copy);
+    destroy_position(pos);
+    free(lengths);
+    free(fens);
+}
+
+// NNUE benchmark run -> plays random games from the start position & evaluates every legal move of every position
+// (make, evaluate, take back), so incremental updates get timed together with what they save. Returns the evaluations
+// per second & adds the scores to the checksum.
+long long nnue_bench_run(long long evaluations, long long *checksum) {
+    position *pos = create_position();
+    parse_fen(pos, start_position);
+
+    long long done = 0, start = get_time_ms();
+    for (int ply = 0; done < evaluations; ply++) {
+        moves move_list[1];
+        generate_legal_moves(pos, move_list);
+
+        // Game over or long enough -> start again
+        if (!move_list->count || ply >= 100) {
+            parse_fen(pos, start_position);
+            ply = -1;
+            continue;
+        }
+
+        for (int count = 0; count < move_list->count; count++) {
+            make_move(pos, move_list->moves[count], legal_move);
+            *checksum += nnue_evaluate(pos);
+            take_back(pos);
+        }
+        done += move_list->count;
+
+        make_move(pos, move_list->moves[get_random_U32_number() % move_list->count], legal_move);
+    }
+    long long elapsed = get_time_ms() - start;
+
+    destroy_position(pos);
+    return elapsed ? done * 1000 / elapsed : 0;
+}
+
+// NNUE benchmark -> evaluations per second with & without incremental accumulator updates, for every kernel set the CPU has
+// (random weights without a network file)
+void nnue_benchmark(int millions, char *path) {
+    if (millions < 1) millions = 1;
+    long long evaluations = (long long)millions * 1000000;
+
+    // Network to time
+    int mode = nnue_mode;
+    if (path != NULL) {
+        if (!nnue_load(path)) {
+            printf("\n    Can't load the network %s\n\n", path);
+            return;
+        }
+    } else if (nnue == NULL && !nnue_init_random()) {
+        printf("\n    Not enough memory for a random network\n\n");
+        return;
+    }
+
+    printf("\n    NNUE benchmark (%d million evaluations per run, %s network)\n\n", millions, path ? path : "random");
+
+    char *kernel_names[3] = { "scalar", "sse4.1", "avx2" };
+    for (int kernels = nnue_avx2; kernels >= nnue_scalar; kernels--) {
+        if (!set_nnue_kernels(kernels)) {
+            printf("    %-8s not supported on this CPU\n", kernel_names[kernels]);
+            continue;
+        }
+
+        // Same games for both modes -> the checksums have to match (& across the kernels too)
+        for (int run = 0; run < 2; run++) {
+            nnue_mode = run ? nnue_refresh : nnue_incremental;
+            unsigned int state = random_state;
+            long long checksum = 0;
+            long long speed = nnue_bench_run(evaluations, &checksum);
+            random_state = state;
+
+            printf("    %-8s %-12s %6lld K evals/s  (checksum %llx)\n", kernel_names[kernels], run ? "refresh" : "incremental",
+                   speed / 1000, (U64)checksum & 0xffff);
+        }
+    }
+    printf("\n");
+
+    // Back to the best kernels & the mode we came in with
+    init_nnue();
+    nnue_mode = (path != NULL) ? nnue_incremental : mode;
+}
+
+/******************************************\
+===========================================
+
+          Magic Number Search
+
+===========================================
+\******************************************/
+
+/*
+    Magic number search -> build with -DGENERATE_MAGICS (make magics) to get genMagics, which searches magic numbers for all
+    128 square/piece pairs at once, spread over threads, & writes them to magic_numbers.h. Building with -DGENERATED_MAGICS
+    then uses those instead of the ones hardcoded above.
+
+        genMagics [file] [threads <n>] [seed <n>] [fewer <bits>] [tries <n>]
+
+    -> Every square/piece pair gets its own random number generator, seeded from the seed & the pair, so the same seed finds
+       the same magics no matter how many threads there are or which thread happens to pick up which pair.
+    -> fewer <bits> keeps looking for magics with up to that many index bits less than the relevant occupancy bits (smaller,
+       denser sub-tables, which only work thanks to constructive collisions), giving up on a bit count after <tries> candidates.
+*/
+
+// Number of square/piece pairs
+#define MAGIC_JOBS 128
+
+// Default number of candidates per square/piece pair & bit count
+#define MAGIC_TRIES 100000000
+
+// Magic search job -> one square of one piece
+typedef struct {
+    int square;
+    int bishop_flag;
+    U64 magic_number;   // what was found (0 if nothing)
+    int magic_bits;     // index bits it needs
+} magic_job;
+
+// Magic search state shared by all the threads
+typedef struct {
+    magic_job jobs[MAGIC_JOBS];
+    int next_job;
+    pthread_mutex_t lock;
+    U64 seed;
+    int fewer_bits;
+    long long tries;
+} magic_search;
+
+// Magic search thread -> keeps taking square/piece pairs until there are none left
+void *magic_search_worker(void *argument) {
+    magic_search *search = (magic_search *)argument;
+
+    while (1) {
+        // Take the next job
+        pthread_mutex_lock(&search->lock);
+        int job_index = search->next_job++;
+        pthread_mutex_unlock(&search->lock);
+        if (job_index >= MAGIC_JOBS) break;
+        magic_job *job = &search->jobs[job_index];
+
+        // This job's random numbers -> SplitMix-style mix of the seed & the job, never 0 (xorshift would get stuck)
+        U64 random_state = search->seed + (U64)(job_index + 1) * 0x9e3779b97f4a7c15ULL;
+        random_state = (random_state ^ (random_state >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        random_state = (random_state ^ (random_state >> 27)) * 0x94d049bb133111ebULL;
+        random_state = (random_state ^ (random_state >> 31)) | 1;
+
+        // Full relevant bits first, then one bit less at a time for as long as magics keep turning up
+        int rel_occ_bits = job->bishop_flag ? bishop_relevant_occ_bits[job->square] : rook_relevant_occ_bits[job->square];
+        for (int bits = rel_occ_bits; bits >= rel_occ_bits - search->fewer_bits; bits--) {
+            U64 magic_number = find_magic_number(job->square, bits, job->bishop_flag, &random_state, search->tries);
+            if (!magic_number) break;
+            job->magic_number = magic_number;
+            job->magic_bits = bits;
+        }
+    }
+
+    return NULL;
+}
+
+// Write the magic numbers as a header -> returns 0 on success
+int write_magic_numbers(char *file_name, magic_search *search) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        printf("Couldn't open %s for writing\n", file_name);
+        return 1;
+    }
+
+    // Sort the jobs back into per piece tables
+    U64 magic_numbers[2][64];
+    int magic_bits[2][64];
+    int table_size = 0;
+    for (int job = 0; job < MAGIC_JOBS; job++) {
+        magic_numbers[search->jobs[job].bishop_flag][search->jobs[job].square] = search->jobs[job].magic_number;
+        magic_bits[search->jobs[job].bishop_flag][search->jobs[job].square] = search->jobs[job].magic_bits;
+        table_size += 1 << search->jobs[job].magic_bits;
+    }
+
+    fprintf(file, "// Magic numbers for bbHighway.c -> generated by 'make magics' (seed %llu, fewer %d, tries %lld), don't edit by hand\n\n",
+            search->seed, search->fewer_bits, search->tries);
+    fprintf(file, "// Size of the fancy slider attacks table with these magics\n#define SLIDER_TABLE_SIZE %d\n", table_size);
+
+    char *names[2] = { "rook", "bishop" };
+    for (int piece = rook; piece <= bishop; piece++) {
+        fprintf(file, "\nU64 %s_magic_numbers[64] = {\n", names[piece]);
+        for (int square = 0; square < 64; square++) {
+            fprintf(file, "    0x%llxULL,\n", magic_numbers[piece][square]);
+        }
+        fprintf(file, "};\n\nconst int %s_magic_bits[64] = {", names[piece]);
+        for (int square = 0; square < 64; square++) {
+            fprintf(file, "%s%2d,", (square % 8) ? " " : "\n    ", magic_bits[piece][square]);
+        }
+        fprintf(file, "\n};\n");
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// Magic search tool (make magics) -> see above for the arguments
+int magic_search_main(int argc, char *argv[]) {
+    // Search settings
+    magic_search *search = calloc(1, sizeof(magic_search));
+    char *file_name = (argc >= 2) ? argv[1] : "magic_numbers.h";
+    int threads = 1;
+    search->seed = 1804289383;
+    search->tries = MAGIC_TRIES;
+    for (int arg = 2; arg + 1 < argc; arg += 2) {
+        if (!strcmp(argv[arg], "threads")) threads = atoi(argv[arg + 1]);
+        else if (!strcmp(argv[arg], "seed")) search->seed = strtoull(argv[arg + 1], NULL, 10);
+        else if (!strcmp(argv[arg], "fewer")) search->fewer_bits = atoi(argv[arg + 1]);
+        else if (!strcmp(argv[arg], "tries")) search->tries = atoll(argv[arg + 1]);
+    }
+    if (threads <= 0) threads = get_cpu_count();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    // Jobs -> rooks first, they take the longest
+    for (int job = 0; job < MAGIC_JOBS; job++) {
+        search->jobs[job].bishop_flag = (job < 64) ? rook : bishop;
+        search->jobs[job].square = job % 64;
+    }
+    pthread_mutex_init(&search->lock, NULL);
+
+    printf("    Searching magic numbers (%d thread%s, seed %llu, up to %d bit%s fewer, %lld tries)\n", threads, (threads == 1) ? "" : "s",
+           search->seed, search->fewer_bits, (search->fewer_bits == 1) ? "" : "s", search->tries);
+
+    // Search
+    long long start = get_time_ms();
+    pthread_t thread_ids[MAX_THREADS];
+    for (int thread = 0; thread < threads; thread++) {
+        pthread_create(&thread_ids[thread], NULL, magic_search_worker, search);
+    }
+    for (int thread = 0; thread < threads; thread++) {
+        pthread_join(thread_ids[thread], NULL);
+    }
+    long long elapsed = get_time_ms() - start;
+    pthread_mutex_destroy(&search->lock);
+
+    // Every pair needs a magic
+    int result = 0, table_size = 0;
+    for (int job = 0; job < MAGIC_JOBS; job++) {
+        if (!search->jobs[job].magic_number) {
+            printf("    No magic number found for the %s on %s\n", search->jobs[job].bishop_flag ? "bishop" : "rook",
+                   square_to_coordinates[search->jobs[job].square]);
+            result = 1;
+        }
+        table_size += 1 << search->jobs[job].magic_bits;
+    }
+
+    if (!result) {
+        printf("    Done in %lld ms -> slider table: %d entries (%d KB)\n", elapsed, table_size, (int)(table_size * sizeof(U64) / 1024));
+        result = write_magic_numbers(file_name, search);
+    }
+
+    free(search);
+    return result;
+}
+
+/******************************************\
+===========================================
+
+               Evaluation
+
+===========================================
+\******************************************/
+
+// Material scores [piece] -> kings don't get a score, both sides always have exactly one
+const int material_score[12] = {
+    100, 320, 330, 500, 900, 0,
+    -100, -320, -330, -500, -900, 0
+};
+
+// Endgame material scores [piece] -> pawns (they can promote) & rooks gain, knights lose reach on an open board
+const int endgame_material_score[12] = {
+    120, 300, 330, 530, 950, 0,
+    -120, -300, -330, -530, -950, 0
+};
+
+/*
+    Piece-square tables -> bonus (or penalty) for a piece standing on a square, from white's point of view
+    (laid out like the board is printed, a8 first). Black pieces look them up on the mirrored square.
+*/
+const int pawn_score[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     10,  10,  20,  30,  30,  20,  10,  10,
+      5,   5,  10,  25,  25,  10,   5,   5,
+      0,   0,   0,  20,  20,   0,   0,   0,
+      5,  -5, -10,   0,   0, -10,  -5,   5,
+      5,  10,  10, -20, -20,  10,  10,   5,
+      0,   0,   0,   0,   0,   0,   0,   0
+};
+
+const int knight_score[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20,   0,   0,   0,   0, -20, -40,
+    -30,   0,  10,  15,  15,  10,   0, -30,
+    -30,   5,  15,  20,  20,  15,   5, -30,
+    -30,   0,  15,  20,  20,  15,   0, -30,
+    -30,   5,  10,  15,  15,  10,   5, -30,
+    -40, -20,   0,   5,   5,   0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50
+};
+
+const int bishop_score[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,  10,  10,   5,   0, -10,
+    -10,   5,   5,  10,  10,   5,   5, -10,
+    -10,   0,  10,  10,  10,  10,   0, -10,
+    -10,  10,  10,  10,  10,  10,  10, -10,
+    -10,   5,   0,   0,   0,   0,   5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20
+};
+
+const int rook_score[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      5,  10,  10,  10,  10,  10,  10,   5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+      0,   0,   0,   5,   5,   0,   0,   0
+};
+
+const int queen_score[64] = {
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,   5,   5,   5,   0, -10,
+     -5,   0,   5,   5,   5,   5,   0,  -5,
+      0,   0,   5,   5,   5,   5,   0,  -5,
+    -10,   5,   5,   5,   5,   5,   0, -10,
+    -10,   0,   5,   0,   0,   0,   0, -10,
+    -20, -10, -10,  -5,  -5, -10, -10, -20
+};
+
+const int king_score[64] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+     20,  20,   0,   0,   0,   0,  20,  20,
+     20,  30,  10,   0,   0,  10,  30,  20
+};
+
+// Endgame pawns -> the closer to promotion the better
+const int pawn_endgame_score[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     80,  80,  80,  80,  80,  80,  80,  80,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     30,  30,  30,  30,  30,  30,  30,  30,
+     15,  15,  15,  15,  15,  15,  15,  15,
+      5,   5,   5,   5,   5,   5,   5,   5,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0
+};
+
+// Endgame king -> no more attack to hide from, so it heads for the centre
+const int king_endgame_score[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50
+};
+
+// Piece-square tables by piece type -> middlegame & endgame (the pieces but pawns & the king keep their middlegame table)
+const int *piece_square_scores[6] = { pawn_score, knight_score, bishop_score, rook_score, queen_score, king_score };
+const int *endgame_piece_square_scores[6] = { pawn_endgame_score, knight_score, bishop_score, rook_score, queen_score, king_endgame_score };
+
+// Mirror a square vertically (a8 <-> a1) -> black pieces use the white piece-square tables through it
+#define mirror_square(square) ((square) ^ 56)
+
+// Fill the packed material + piece-square scores make_move keeps the position's score up to date with (see Incremental Evaluation)
+void init_piece_square_values() {
+    for (int piece = P; piece <= k; piece++) {
+        for (int square = 0; square < 64; square++) {
+            int mg, eg;
+            if (piece <= K) {
+                mg = material_score[piece] + piece_square_scores[piece][square];
+                eg = endgame_material_score[piece] + endgame_piece_square_scores[piece][square];
+            } else {
+                mg = material_score[piece] - piece_square_scores[piece - p][mirror_square(square)];
+                eg = endgame_material_score[piece] - endgame_piece_square_scores[piece - p][mirror_square(square)];
+            }
+            piece_square_values[piece][square] = make_score(mg, eg);
+        }
+    }
+}
+
+/*
+    Pawn structure -> evaluated with bitboard fills over all the pawns at once (white moves towards a8, so "north" is >>)
+
+    passed      no enemy pawn in front of it on its own or an adjacent file (bonus by rank)
+    doubled     another pawn of the same side in front of it on its file
+    isolated    no pawn of the same side on an adjacent file
+    backward    its stop square is attacked by an enemy pawn & no pawn of its own can ever defend it (not isolated)
+
+    The pawns only change on a few moves, so the result is cached in a small per-thread pawn hash table under the pawn key
+    (see Zobrist Keys). Besides the score, an entry keeps the passed pawns & the pawn attack spans (every square a side's
+    pawns may ever attack) of both sides, so the evaluation terms that also depend on the pieces can use them for free.
+*/
+
+// Passed pawn bonus [rank from the pawn's own side] -> middlegame & endgame
+const int passed_pawn_mg[8] = { 0, 5, 10, 15, 25, 40, 60, 0 };
+const int passed_pawn_eg[8] = { 0, 10, 15, 25, 45, 70, 110, 0 };
+
+// Extra endgame bonus for a passed pawn whose stop square is empty [rank from the pawn's own side]
+const int free_passed_pawn_eg[8] = { 0, 0, 5, 10, 20, 35, 50, 0 };
+
+// Pawn structure penalties (packed middlegame & endgame scores, see make_score)
+#define DOUBLED_PAWN_PENALTY make_score(-10, -20)
+#define ISOLATED_PAWN_PENALTY make_score(-10, -15)
+#define BACKWARD_PAWN_PENALTY make_score(-8, -10)
+
+// Knight outpost -> on the enemy's half, defended by a pawn & out of reach of the enemy pawns
+#define KNIGHT_OUTPOST_BONUS make_score(20, 10)
+
+// Fill a bitboard towards rank 8 / rank 1 (the squares themselves included)
+static inline U64 north_fill(U64 bitboard) {
+    bitboard |= bitboard >> 8;
+    bitboard |= bitboard >> 16;
+    bitboard |= bitboard >> 32;
+    return bitboard;
+}
+
+static inline U64 south_fill(U64 bitboard) {
+    bitboard |= bitboard << 8;
+    bitboard |= bitboard << 16;
+    bitboard |= bitboard << 32;
+    return bitboard;
+}
+
+// Squares attacked by a set of white / black pawns
+static inline U64 white_pawn_attacks(U64 pawns) {
+    return ((pawns >> 7) & not_a_file) | ((pawns >> 9) & not_h_file);
+}
+
+static inline U64 black_pawn_attacks(U64 pawns) {
+    return ((pawns << 7) & not_h_file) | ((pawns << 9) & not_a_file);
+}
+
+// Files next to the files of a set of (file filled) squares
+static inline U64 adjacent_files(U64 files) {
+    return ((files >> 1) & not_h_file) | ((files << 1) & not_a_file);
+}
+
+// Pawn hash table entry -> pawn key, packed pawn structure score (white's point of view), passed pawns & attack spans [side]
+typedef struct {
+    U64 key;
+    int score;
+    U64 passed[2];
+    U64 attack_span[2];
+} pawn_entry;
+
+// Pawn hash table size in entries (power of 2)
+#define PAWN_TABLE_ENTRIES 16384
+
+// Pawn hash table -> one per search thread, so there's nothing to synchronize. Probes & hits count for the statistics.
+typedef struct {
+    pawn_entry entries[PAWN_TABLE_ENTRIES];
+    U64 probes;
+    U64 hits;
+} pawn_table;
+
+// Sum the penalties of one side's weak pawns
+static inline int pawn_weakness_score(U64 doubled, U64 isolated, U64 backward) {
+    return count_bits(doubled) * DOUBLED_PAWN_PENALTY +
+           count_bits(isolated) * ISOLATED_PAWN_PENALTY +
+           count_bits(backward) * BACKWARD_PAWN_PENALTY;
+}
+
+// Evaluate the pawn structure from scratch into a pawn hash table entry
+static void evaluate_pawns(position *pos, pawn_entry *entry) {
+    U64 white_pawns = pos->bitboards[P];
+    U64 black_pawns = pos->bitboards[p];
+    U64 white_attacks = white_pawn_attacks(white_pawns);
+    U64 black_attacks = black_pawn_attacks(black_pawns);
+
+    // Attack spans -> the attacked squares & everything in front of them
+    entry->attack_span[white] = north_fill(white_attacks);
+    entry->attack_span[black] = south_fill(black_attacks);
+
+    // Passed pawns -> not in front of (or attacked by) an enemy pawn on its own or an adjacent file
+    entry->passed[white] = white_pawns & ~south_fill(black_pawns | black_attacks);
+    entry->passed[black] = black_pawns & ~north_fill(white_pawns | white_attacks);
+
+    // Doubled pawns -> the ones with a pawn of the same side in front of them
+    U64 white_doubled = white_pawns & south_fill(white_pawns << 8);
+    U64 black_doubled = black_pawns & north_fill(black_pawns >> 8);
+
+    // Isolated pawns
+    U64 white_isolated = white_pawns & ~adjacent_files(north_fill(white_pawns) | south_fill(white_pawns));
+    U64 black_isolated = black_pawns & ~adjacent_files(north_fill(black_pawns) | south_fill(black_pawns));
+
+    // Backward pawns -> stop square attacked by an enemy pawn & out of the own attack span
+    U64 white_backward = white_pawns & ((black_attacks & ~entry->attack_span[white]) << 8) & ~white_isolated;
+    U64 black_backward = black_pawns & ((white_attacks & ~entry->attack_span[black]) >> 8) & ~black_isolated;
+
+    int score = pawn_weakness_score(white_doubled, white_isolated, white_backward) -
+                pawn_weakness_score(black_doubled, black_isolated, black_backward);
+
+    // Passed pawn bonus by rank
+    U64 bitboard = entry->passed[white];
+    while (bitboard) {
+        int square = get_ls1b_index(bitboard);
+        int rank = 7 - (square >> 3);
+        score += make_score(passed_pawn_mg[rank], passed_pawn_eg[rank]);
+        pop_bit(bitboard, square);
+    }
+
+    bitboard = entry->passed[black];
+    while (bitboard) {
+        int square = get_ls1b_index(bitboard);
+        int rank = square >> 3;
+        score -= make_score(passed_pawn_mg[rank], passed_pawn_eg[rank]);
+        pop_bit(bitboard, square);
+    }
+
+    entry->score = score;
+}
+
+// Look the pawn structure up in the pawn hash table -> evaluated & stored on a miss
+static inline pawn_entry *probe_pawn_table(position *pos, pawn_table *table) {
+    pawn_entry *entry = &table->entries[pos->pawn_key & (PAWN_TABLE_ENTRIES - 1)];
+
+    table->probes++;
+    if (entry->key == pos->pawn_key) {
+        table->hits++;
+        return entry;
+    }
+
+    evaluate_pawns(pos, entry);
+    entry->key = pos->pawn_key;
+    return entry;
+}
+
+// Evaluate the position -> score from the side to move's point of view. The pawn hash table may be NULL (the pawn structure
+// then gets evaluated from scratch).
+static inline int evaluate(position *pos, pawn_table *table) {
+    // Network evaluation when one is loaded (see NNUE)
+    if (nnue_mode != nnue_off) {
+        return nnue_evaluate(pos);
+    }
+
+    // Material & piece-square score from white's point of view (see Incremental Evaluation)
+    int score = pos->psq_score;
+
+    // Pawn structure
+    pawn_entry local_entry;
+    pawn_entry *pawns = &local_entry;
+    if (table) {
+        pawns = probe_pawn_table(pos, table);
+    } else {
+        evaluate_pawns(pos, pawns);
+    }
+    score += pawns->score;
+
+    // Passed pawns that can advance right away
+    U64 bitboard = pawns->passed[white] & (~pos->occupancies[both] << 8);
+    while (bitboard) {
+        int square = get_ls1b_index(bitboard);
+        score += make_score(0, free_passed_pawn_eg[7 - (square >> 3)]);
+        pop_bit(bitboard, square);
+    }
+
+    bitboard = pawns->passed[black] & (~pos->occupancies[both] >> 8);
+    while (bitboard) {
+        int square = get_ls1b_index(bitboard);
+        score -= make_score(0, free_passed_pawn_eg[square >> 3]);
+        pop_bit(bitboard, square);
+    }
+
+    // Knight outposts (ranks 4 to 6 from the knight's side)
+    U64 white_outposts = 0x0000FFFFFF000000ULL & white_pawn_attacks(pos->bitboards[P]) & ~pawns->attack_span[black];
+    U64 black_outposts = 0x000000FFFFFF0000ULL & black_pawn_attacks(pos->bitboards[p]) & ~pawns->attack_span[white];
+    score += (count_bits(pos->bitboards[N] & white_outposts) - count_bits(pos->bitboards[n] & black_outposts)) * KNIGHT_OUTPOST_BONUS;
+
+    // Taper between the middlegame & endgame scores by the game phase (promotions can push the phase past the start)
+    int phase = (pos->phase < MAX_PHASE) ? pos->phase : MAX_PHASE;
+    score = (score_mg(score) * phase + score_eg(score) * (MAX_PHASE - phase)) / MAX_PHASE;
+
+    // Flip the score for black
+    return (pos->side == white) ? score : -score;
+}
+
+/******************************************\
+===========================================
+
+                 Search
+
+===========================================
+\******************************************/
+
+// Aspiration window half width
+#define ASPIRATION_WINDOW 50
+
+/*
+    Move ordering -> the move picker hands the moves out in stages (see next_move)
+
+    hash move (from the transposition table)     checked for validity, never generated
+    captures & promotions                        MVV-LVA (queen promotions first, underpromotions last), losing ones (SEE < 0) put off
+    1st & 2nd killer moves                       checked for validity, never generated
+    counter move                                 checked for validity, never generated
+    other quiet moves                            history score
+    losing captures                              in MVV-LVA order (quiescence drops them)
+*/
+
+// MVV-LVA [attacker][victim] -> most valuable victim first, least valuable attacker breaks ties
+const int mvv_lva[12][12] = {
+    { 105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605 },
+    { 104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604 },
+    { 103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603 },
+    { 102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602 },
+    { 101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601 },
+    { 100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600 },
+
+    { 105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605 },
+    { 104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604 },
+    { 103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603 },
+    { 102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602 },
+    { 101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601 },
+    { 100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600 }
+};
+
+// Search limits & stop flag -> shared by everything that searches
+typedef struct {
+    // Depth limit
+    int depth;
+
+    // Time limit -> stop_time only counts when time_set is on
+    long long start_time;
+    long long stop_time;
+    int time_set;
+
+    // "go infinite" -> the best move only gets reported once the search is stopped from outside
+    int infinite;
+
+    // Don't print anything (benchmarks)
+    int silent;
+
+    // Set to stop the search (by the time check or from outside)
+    volatile int stopped;
+
+    // Node limit per thread (0 = none) -> checked along with the time
+    U64 nodes;
+} search_limits;
+
+struct search_pool;
+
+// Search thread data -> everything a search writes to, so every thread can have its own
+typedef struct search_data {
+    // Thread id (0 = main thread) & the pool the thread belongs to
+    int id;
+    struct search_pool *pool;
+
+    // Board being searched
+    position *pos;
+
+    // Shared limits
+    search_limits *limits;
+
+    // Nodes searched & distance to the root
+    U64 nodes;
+    int ply;
+
+    // Killer moves [id][ply], history moves [piece][square] & counter moves [previous move's piece][previous move's target square]
+    int killer_moves[2][MAX_PLY];
+    int history_moves[12][64];
+    int counter_moves[12][64];
+
+    // Principal variation -> triangular PV table
+    int pv_length[MAX_PLY];
+    int pv_table[MAX_PLY][MAX_PLY];
+
+    // Deepest fully searched iteration & its best move & score
+    int completed_depth;
+    int best_move;
+    int best_score;
+
+    // Pawn hash table (see Evaluation)
+    pawn_table *pawns;
+} search_data;
+
+// Search pool -> the threads searching together & their board copies
+typedef struct search_pool {
+    search_data *threads;
+    position *positions;
+    int thread_count;
+} search_pool;
+
+// Check whether the search has to stop -> called every 2048 nodes (so the node limit is only kept to within 2048 nodes)
+static inline void check_time(search_data *data) {
+    // Always finish depth 1, so there's a move to play
+    if (data->limits->time_set && data->completed_depth && get_time_ms() > data->limits->stop_time) {
+        data->limits->stopped = 1;
+    }
+
+    // Same for the node limit
+    if (data->limits->nodes && data->completed_depth && data->nodes >= data->limits->nodes) {
+        data->limits->stopped = 1;
+    }
+}
+
+// Is the side to move in check?
+static inline int in_check(position *pos) {
+    return is_square_attacked(pos, get_ls1b_index(pos->bitboards[(pos->side == white) ? K : k]), pos->side ^ 1);
+}
+
+// Has the current position come up before? -> only positions with the same side to move since the last irreversible move count
+static inline int is_repetition(position *pos) {
+    for (int index = pos->undo_count - 2; index >= 0 && index >= pos->undo_count - pos->half_moves; index -= 2) {
+        if (pos->undo_stack[index].hash_key == pos->hash_key) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Score a capture or promotion -> MVV-LVA, with queen promotions on top & underpromotions at the back
+static inline int score_noisy_move(position *pos, int move) {
+    int score = 0;
+
+    if (get_move_capture(move)) {
+        // En passant captures a pawn (the target square is empty)
+        int target_piece = P;
+
+        // Find the captured piece on the target square
+        int start_piece = (pos->side == white) ? p : P;
+        int end_piece = (pos->side == white) ? k : K;
+        for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++) {
+            if (get_bit(pos->bitboards[bb_piece], get_move_target(move))) {
+                target_piece = bb_piece;
+                break;
+            }
+        }
+
+        score = mvv_lva[get_move_piece(move)][target_piece];
+    }
+
+    if (get_move_promoted(move)) {
+        score += (get_move_promoted(move) == Q || get_move_promoted(move) == q) ? 1000 : -1000;
+    }
+
+    return score;
+}
+
+// Bring the best scored move left in the list to the given index -> selection sort, one step at a time, since most nodes
+// cut off long before the whole list has been looked at
+static inline void pick_move(moves *move_list, int *move_scores, int index) {
+    int best = index;
+    for (int count = index + 1; count < move_list->count; count++) {
+        if (move_scores[count] > move_scores[best]) {
+            best = count;
+        }
+    }
+
+    // Swap the best move into place
+    int move = move_list->moves[index];
+    int score = move_scores[index];
+    move_list->moves[index] = move_list->moves[best];
+    move_scores[index] = move_scores[best];
+    move_list->moves[best] = move;
+    move_scores[best] = score;
+}
+
+// Move picker stages
+enum { stage_hash_move, stage_init_captures, stage_captures, stage_killer_1, stage_killer_2, stage_counter_move,
+       stage_init_quiets, stage_quiets, stage_bad_captures, stage_done };
+
+// Move picker -> where a node is in its move list
+typedef struct {
+    // Current stage & the position in the generated list
+    int stage;
+    int index;
+
+    // Stop after the captures (quiescence)
+    int captures_only;
+
+    // Moves tried before they're generated
+    int hash_move;
+    int killers[2];
+    int counter_move;
+
+    // Moves of the current stage & their scores
+    moves move_list[1];
+    int move_scores[MAX_MOVES];
+
+    // Captures that lose material (SEE < 0) -> tried after the quiet moves
+    moves bad_captures[1];
+} move_picker;
+
+// Set up a move picker for the node at the current ply
+static inline void init_move_picker(search_data *data, move_picker *picker, int hash_move, int captures_only) {
+    position *pos = data->pos;
+
+    picker->stage = captures_only ? stage_init_captures : stage_hash_move;
+    picker->index = 0;
+    picker->bad_captures->count = 0;
+    picker->captures_only = captures_only;
+    picker->hash_move = hash_move;
+    picker->killers[0] = data->killer_moves[0][data->ply];
+    picker->killers[1] = data->killer_moves[1][data->ply];
+
+    // Counter move -> the reply that last refuted the opponent's move (none after a null move)
+    int previous_move = pos->undo_count ? pos->undo_stack[pos->undo_count - 1].move : 0;
+    picker->counter_move = previous_move ? data->counter_moves[get_move_piece(previous_move)][get_move_target(previous_move)] : 0;
+}
+
+// Can a remembered quiet move (killer or counter move) be played here? -> it mustn't be the hash move (already tried)
+static inline int is_quiet_move_playable(move_picker *picker, position *pos, int move) {
+    return move && move != picker->hash_move && !get_move_capture(move) && !get_move_promoted(move) &&
+           is_move_pseudo_legal(pos, move) && is_move_legal(pos, move);
+}
+
+// Next move to search -> 0 once the moves have run out. Every move handed out is legal
+// (make it with make_move(pos, move, legal_move)).
+static inline int next_move(search_data *data, move_picker *picker) {
+    position *pos = data->pos;
+    int move;
+
+    switch (picker->stage) {
+        // Hash move -> may come from a different position with the same hash key (or index), so check it
+        case stage_hash_move:
+            picker->stage = stage_init_captures;
+            if (picker->hash_move && is_move_pseudo_legal(pos, picker->hash_move) && is_move_legal(pos, picker->hash_move)) {
+                return picker->hash_move;
+            }
+            // fall through
+
+        // Captures & promotions
+        case stage_init_captures:
+            generate_legal_noisy(pos, picker->move_list);
+            for (int count = 0; count < picker->move_list->count; count++) {
+                picker->move_scores[count] = score_noisy_move(pos, picker->move_list->moves[count]);
+            }
+            picker->index = 0;
+            picker->stage = stage_captures;
+            // fall through
+
+        case stage_captures:
+            while (picker->index < picker->move_list->count) {
+                pick_move(picker->move_list, picker->move_scores, picker->index);
+                move = picker->move_list->moves[picker->index++];
+                if (move == picker->hash_move) continue;
+
+                // Losing captures -> put off until after the quiet moves (or dropped in quiescence)
+                if (!get_move_promoted(move) && see(pos, move) < 0) {
+                    if (!picker->captures_only) add_move(picker->bad_captures, move);
+                    continue;
+                }
+
+                return move;
+            }
+            if (picker->captures_only) {
+                picker->stage = stage_done;
+                return 0;
+            }
+            picker->stage = stage_killer_1;
+            // fall through
+
+        // Killer moves
+        case stage_killer_1:
+            picker->stage = stage_killer_2;
+            if (is_quiet_move_playable(picker, pos, picker->killers[0])) {
+                return picker->killers[0];
+            }
+            // fall through
+
+        case stage_killer_2:
+            picker->stage = stage_counter_move;
+            if (picker->killers[1] != picker->killers[0] && is_quiet_move_playable(picker, pos, picker->killers[1])) {
+                return picker->killers[1];
+            }
+            // fall through
+
+        // Counter move
+        case stage_counter_move:
+            picker->stage = stage_init_quiets;
+            move = picker->counter_move;
+            if (move != picker->killers[0] && move != picker->killers[1] && is_quiet_move_playable(picker, pos, move)) {
+                return move;
+            }
+            // fall through
+
+        // The rest of the quiet moves
+        case stage_init_quiets:
+            generate_legal_quiets(pos, picker->move_list);
+            for (int count = 0; count < picker->move_list->count; count++) {
+                move = picker->move_list->moves[count];
+                picker->move_scores[count] = data->history_moves[get_move_piece(move)][get_move_target(move)];
+            }
+            picker->index = 0;
+            picker->stage = stage_quiets;
+            // fall through
+
+        case stage_quiets:
+            while (picker->index < picker->move_list->count) {
+                pick_move(picker->move_list, picker->move_scores, picker->index);
+                move = picker->move_list->moves[picker->index++];
+
+                // Skip the moves that were tried before the generation
+                if (move != picker->hash_move && move != picker->killers[0] && move != picker->killers[1] &&
+                    move != picker->counter_move) {
+                    return move;
+                }
+            }
+            picker->index = 0;
+            picker->stage = stage_bad_captures;
+            // fall through
+
+        // Losing captures -> already in MVV-LVA order
+        case stage_bad_captures:
+            if (picker->index < picker->bad_captures->count) {
+                return picker->bad_captures->moves[picker->index++];
+            }
+            picker->stage = stage_done;
+            // fall through
+
+        default:
+            return 0;
+    }
+}
+
+// Quiescence search -> only captures (& promotions) that don't lose material, so the static evaluation is never taken in the middle of an exchange
+static int quiescence(search_data *data, int alpha, int beta) {
+    position *pos = data->pos;
+
+    // Check the time every 2048 nodes
+    if ((data->nodes & 2047) == 0) {
+        check_time(data);
+    }
+
+    data->nodes++;
+
+    // Too deep -> just evaluate
+    if (data->ply > MAX_PLY - 1) {
+        return evaluate(pos, data->pawns);
+    }
+
+    // Stand pat -> the side to move doesn't have to capture
+    int evaluation = evaluate(pos, data->pawns);
+    if (evaluation >= beta) {
+        return beta;
+    }
+    if (evaluation > alpha) {
+        alpha = evaluation;
+    }
+
+    // Loop over the captures & promotions
+    move_picker picker[1];
+    init_move_picker(data, picker, 0, 1);
+    int move;
+    while ((move = next_move(data, picker))) {
+        // Make the capture
+        data->ply++;
+        make_move(pos, move, legal_move);
+
+        int score = -quiescence(data, -beta, -alpha);
+
+        data->ply--;
+        take_back(pos);
+
+        // Out of time -> the score can't be trusted
+        if (data->limits->stopped) {
+            return 0;
+        }
+
+        if (score > alpha) {
+            alpha = score;
+
+            // Fail high
+            if (score >= beta) {
+                return beta;
+            }
+        }
+    }
+
+    return alpha;
+}
+
+// Negamax alpha-beta search with principal variation search, null move pruning & late move reductions
+static int negamax(search_data *data, int alpha, int beta, int depth, int do_null) {
+    position *pos = data->pos;
+
+    // Too deep -> just evaluate (before anything indexed by the ply gets touched)
+    if (data->ply > MAX_PLY - 1) {
+        return evaluate(pos, data->pawns);
+    }
+
+    // Initialize the PV length
+    data->pv_length[data->ply] = data->ply;
+
+    // Is this a PV node (open window)?
+    int pv_node = beta - alpha > 1;
+
+    // Draw by repetition or the fifty move rule
+    if (data->ply && (is_repetition(pos) || pos->half_moves >= 100)) {
+        return 0;
+    }
+
+    // Probe the transposition table (not at the root & not in PV nodes, where we want the whole PV)
+    int hash_move = 0, hash_score, hash_depth, hash_bound;
+    if (tt_probe(pos->hash_key, data->ply, &hash_move, &hash_score, &hash_depth, &hash_bound) &&
+        data->ply && !pv_node && hash_depth >= depth) {
+        if (hash_bound == bound_exact) return hash_score;
+        if (hash_bound == bound_upper && hash_score <= alpha) return alpha;
+        if (hash_bound == bound_lower && hash_score >= beta) return beta;
+    }
+
+    // Check the time every 2048 nodes
+    if ((data->nodes & 2047) == 0) {
+        check_time(data);
+    }
+
+    // Horizon -> resolve the captures
+    if (depth <= 0) {
+        return quiescence(data, alpha, beta);
+    }
+
+    data->nodes++;
+
+    // Check extension
+    int checked = in_check(pos);
+    if (checked) {
+        depth++;
+    }
+
+    // Null move pruning -> if passing still fails high at a reduced depth, a real move would too.
+    // Not when in check (passing would be illegal) & not without pieces (zugzwang is common in pawn endgames).
+    if (do_null && !checked && !pv_node && data->ply && depth >= 3) {
+        U64 side_pieces = pos->occupancies[pos->side] ^ pos->bitboards[(pos->side == white) ? P : p] ^
+                          pos->bitboards[(pos->side == white) ? K : k];
+        if (side_pieces) {
+            // Reduction -> R = 2, 3 from depth 6 on
+            int reduction = (depth >= 6) ? 3 : 2;
+
+            data->ply++;
+            make_null_move(pos);
+            int score = -negamax(data, -beta, -beta + 1, depth - 1 - reduction, 0);
+            take_back_null_move(pos);
+            data->ply--;
+
+            if (data->limits->stopped) {
+                return 0;
+            }
+
+            if (score >= beta) {
+                return beta;
+            }
+        }
+    }
+
+    // Moves come out of the move picker one at a time
+    move_picker picker[1];
+    init_move_picker(data, picker, hash_move, 0);
+
+    // Legal moves found, moves searched, best move & the bound the result is going to be
+    int legal_moves = 0;
+    int moves_searched = 0;
+    int best_move = 0;
+    int bound = bound_upper;
+
+    // Loop over the moves
+    int move;
+    while ((move = next_move(data, picker))) {
+
+        // Make the move (they're all legal)
+        data->ply++;
+        make_move(pos, move, legal_move);
+        legal_moves++;
+
+        int score;
+        if (moves_searched == 0) {
+            // First move -> full window
+            score = -negamax(data, -beta, -alpha, depth - 1, 1);
+        } else {
+            // Late move reduction -> quiet moves ordered late are unlikely to be any good, so try them at reduced depth first
+            if (moves_searched >= 4 && depth >= 3 && !checked && !get_move_capture(move) && !get_move_promoted(move) &&
+                !in_check(pos)) {
+                score = -negamax(data, -alpha - 1, -alpha, depth - 2, 1);
+            } else {
+                // Skip straight to the PVS search below
+                score = alpha + 1;
+            }
+
+            // Principal variation search -> prove the move is worse than the best one so far with a null window,
+            // & only search it again with the full window if that fails
+            if (score > alpha) {
+                score = -negamax(data, -alpha - 1, -alpha, depth - 1, 1);
+                if (score > alpha && score < beta) {
+                    score = -negamax(data, -beta, -alpha, depth - 1, 1);
+                }
+            }
+        }
+
+        data->ply--;
+        take_back(pos);
+        moves_searched++;
+
+        // Out of time -> the score can't be trusted
+        if (data->limits->stopped) {
+            return 0;
+        }
+
+        // Found a better move
+        if (score > alpha) {
+            best_move = move;
+            bound = bound_exact;
+
+            // Quiet moves get a history bonus
+            if (!get_move_capture(move) && !get_move_promoted(move)) {
+                data->history_moves[get_move_piece(move)][get_move_target(move)] += depth * depth;
+            }
+
+            alpha = score;
+
+            // Write the PV move & copy the PV from the deeper ply (there's none past the last ply)
+            int child_length = (data->ply + 1 < MAX_PLY) ? data->pv_length[data->ply + 1] : data->ply + 1;
+            data->pv_table[data->ply][data->ply] = move;
+            for (int next_ply = data->ply + 1; next_ply < child_length; next_ply++) {
+                data->pv_table[data->ply][next_ply] = data->pv_table[data->ply + 1][next_ply];
+            }
+            data->pv_length[data->ply] = child_length;
+
+            // Fail high
+            if (score >= beta) {
+                tt_store(pos->hash_key, data->ply, best_move, beta, depth, bound_lower);
+
+                // Quiet moves become killers & the counter move to the opponent's last move
+                if (!get_move_capture(move) && !get_move_promoted(move)) {
+                    if (data->killer_moves[0][data->ply] != move) {
+                        data->killer_moves[1][data->ply] = data->killer_moves[0][data->ply];
+                        data->killer_moves[0][data->ply] = move;
+                    }
+
+                    int previous_move = pos->undo_count ? pos->undo_stack[pos->undo_count - 1].move : 0;
+                    if (previous_move) {
+                        data->counter_moves[get_move_piece(previous_move)][get_move_target(previous_move)] = move;
+                    }
+                }
+
+                return beta;
+            }
+        }
+    }
+
+    // No legal moves -> checkmate or stalemate
+    if (legal_moves == 0) {
+        return checked ? -MATE_VALUE + data->ply : 0;
+    }
+
+    // Store the result
+    tt_store(pos->hash_key, data->ply, best_move, alpha, depth, bound);
+
+    return alpha;
+}
+
+// Write a score in UCI format to a stream -> centipawns or moves to mate
+void fprint_score(FILE *stream, int score) {
+    if (score > MATE_SCORE) {
+        fprintf(stream, "mate %d", (MATE_VALUE - score) / 2 + 1);
+    } else if (score < -MATE_SCORE) {
+        fprintf(stream, "mate %d", -(MATE_VALUE + score) / 2);
+    } else {
+        fprintf(stream, "cp %d", score);
+    }
+}
+
+// Print a score in UCI format
+void print_score(int score) {
+    fprint_score(stdout, score);
+}
+
+// Search one thread's iterative deepening loop with aspiration windows -> returns the best move of the deepest completed
+// iteration. Only the main thread (id 0) reports the iterations.
+int search_position(search_data *data) {
+    search_limits *limits = data->limits;
+
+    // Reset the search data
+    data->nodes = 0;
+    data->ply = 0;
+    data->completed_depth = 0;
+    data->best_move = 0;
+    data->best_score = 0;
+    memset(data->killer_moves, 0, sizeof(data->killer_moves));
+    memset(data->history_moves, 0, sizeof(data->history_moves));
+    memset(data->counter_moves, 0, sizeof(data->counter_moves));
+    memset(data->pv_table, 0, sizeof(data->pv_table));
+    memset(data->pv_length, 0, sizeof(data->pv_length));
+    data->pawns->probes = 0;
+    data->pawns->hits = 0;
+
+    // Search window
+    int alpha = -INF;
+    int beta = INF;
+
+    // Iterative deepening -> helper threads with an odd id start one ply deeper, so the threads don't all search the same
+    // depth at the same time & share more useful entries through the transposition table
+    for (int current_depth = 1 + (data->id & 1); current_depth <= limits->depth; current_depth++) {
+        int score = negamax(data, alpha, beta, current_depth, 1);
+
+        // Out of time -> keep the last completed iteration
+        if (limits->stopped) {
+            break;
+        }
+
+        // Fell outside the aspiration window -> search the same depth again with a full window
+        if (score <= alpha || score >= beta) {
+            alpha = -INF;
+            beta = INF;
+            current_depth--;
+            continue;
+        }
+
+        // Next iteration's aspiration window
+        alpha = score - ASPIRATION_WINDOW;
+        beta = score + ASPIRATION_WINDOW;
+
+        // Iteration done
+        data->best_move = data->pv_table[0][0];
+        data->best_score = score;
+        data->completed_depth = current_depth;
+
+        // Report the iteration (nodes over all the threads)
+        if (data->id == 0 && !limits->silent) {
+            U64 nodes = 0;
+            for (int thread = 0; thread < data->pool->thread_count; thread++) {
+                nodes += data->pool->threads[thread].nodes;
+            }
+
+            long long elapsed = get_time_ms() - limits->start_time;
+            printf("info depth %d score ", current_depth);
+            print_score(score);
+            printf(" nodes %llu nps %llu time %lld hashfull %d pv", nodes,
+                   elapsed ? nodes * 1000 / elapsed : nodes * 1000, elapsed, tt_hashfull());
+            for (int count = 0; count < data->pv_length[0]; count++) {
+                printf(" ");
+                print_move(data->pv_table[0][count]);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+
+        // A forced mate has been found within the search depth -> searching deeper won't change the move
+        if ((score > MATE_SCORE || score < -MATE_SCORE) && current_depth > MATE_VALUE - abs(score)) {
+            break;
+        }
+    }
+
+    return data->best_move;
+}
+
+/*
+    Lazy SMP -> every thread searches the same root position on its own copy of the board, with its own killer & history
+    tables. The threads never talk to each other directly: they only share the (lockless) transposition table, so whatever one
+    thread finds speeds up the others. Once the main thread is done (or time's up) all threads stop, & the move of the thread
+    with the deepest completed iteration gets played.
+*/
+
+// Free a search pool (a partly built one too)
+void destroy_search_pool(search_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    for (int thread = 0; thread < pool->thread_count; thread++) {
+        aligned_free(pool->threads[thread].pawns);
+    }
+    aligned_free(pool->positions);
+    aligned_free(pool->threads);
+    aligned_free(pool);
+}
+
+// Allocate a search pool with the given number of threads -> NULL if there isn't enough memory
+search_pool *create_search_pool(int thread_count) {
+    search_pool *pool = aligned_calloc(1, sizeof(search_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->threads = aligned_calloc(thread_count, sizeof(search_data));
+    pool->positions = aligned_calloc(thread_count, sizeof(position));
+    if (pool->threads == NULL || pool->positions == NULL) {
+        destroy_search_pool(pool);
+        return NULL;
+    }
+    pool->thread_count = thread_count;
+
+    for (int thread = 0; thread < thread_count; thread++) {
+        pool->threads[thread].id = thread;
+        pool->threads[thread].pool = pool;
+        pool->threads[thread].pos = &pool->positions[thread];
+        pool->threads[thread].pawns = aligned_calloc(1, sizeof(pawn_table));
+        if (pool->threads[thread].pawns == NULL) {
+            destroy_search_pool(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+// Helper thread entry point
+static void *search_helper_thread(void *argument) {
+    search_position(argument);
+    return NULL;
+}
+
+// Search the position with all the threads of the pool & print the best move -> returns the best move
+int search_smp(search_pool *pool, position *pos, search_limits *limits) {
+    // Give every thread its own copy of the root position
+    for (int thread = 0; thread < pool->thread_count; thread++) {
+        memcpy(&pool->positions[thread], pos, sizeof(position));
+        pool->threads[thread].limits = limits;
+        pool->threads[thread].nodes = 0;
+    }
+
+    limits->stopped = 0;
+    tt_new_search();
+
+    // Start the helpers & search on this thread as the main thread
+    pthread_t helpers[MAX_THREADS];
+    for (int thread = 1; thread < pool->thread_count; thread++) {
+        pthread_create(&helpers[thread], NULL, search_helper_thread, &pool->threads[thread]);
+    }
+    search_position(&pool->threads[0]);
+
+    // Infinite search -> hold the best move back until we're told to stop
+    while (limits->infinite && !limits->stopped) {
+        #ifdef _WIN64
+            Sleep(1);
+        #else
+            usleep(1000);
+        #endif
+    }
+
+    // The main thread is done -> stop the helpers
+    limits->stopped = 1;
+    for (int thread = 1; thread < pool->thread_count; thread++) {
+        pthread_join(helpers[thread], NULL);
+    }
+
+    // Pick the thread with the deepest completed iteration (the main thread wins ties)
+    search_data *best = &pool->threads[0];
+    for (int thread = 1; thread < pool->thread_count; thread++) {
+        search_data *data = &pool->threads[thread];
+        if (data->best_move && data->completed_depth > best->completed_depth) {
+            best = data;
+        }
+    }
+
+    // Print the pawn hash table hit rate over all the threads & the best move
+    if (!limits->silent) {
+        U64 probes = 0, hits = 0;
+        for (int thread = 0; thread < pool->thread_count; thread++) {
+            probes += pool->threads[thread].pawns->probes;
+            hits += pool->threads[thread].pawns->hits;
+        }
+        if (probes) {
+            printf("info string pawn hash probes %llu hits %llu (%.1f%%)\n", probes, hits, 100.0 * hits / probes);
+        }
+
+        printf("bestmove ");
+        if (best->best_move) {
+            print_move(best->best_move);
+        } else {
+            printf("(none)");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return best->best_move;
+}
+
+// Lazy SMP scaling benchmark -> searches the debug positions to a fixed depth with 1, 2, 4, ... threads (up to max_threads)
+// & reports the time to depth, nodes per second & speedup over one thread
+void smp_benchmark(int depth, int max_threads) {
+    char *fens[] = { start_position, tricky_position, killer_position, cmk_position };
+    int fen_count = sizeof(fens) / sizeof(fens[0]);
+    position *pos = create_position();
+
+    printf("\n    Lazy SMP scaling benchmark (depth %d)\n\n", depth);
+    printf("    threads   time to depth (ms)   nodes          nps          speedup\n");
+
+    long long single_thread_time = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        search_pool *pool = create_search_pool(threads);
+        if (pool == NULL) {
+            printf("    %7d   not enough memory for the search threads\n", threads);
+            break;
+        }
+        long long total_time = 0;
+        U64 total_nodes = 0;
+
+        // Search every debug position from an empty transposition table
+        for (int fen = 0; fen < fen_count; fen++) {
+            parse_fen(pos, fens[fen]);
+            tt_clear();
+
+            search_limits limits = { .depth = depth, .start_time = get_time_ms(), .silent = 1 };
+            search_smp(pool, pos, &limits);
+
+            total_time += get_time_ms() - limits.start_time;
+            for (int thread = 0; thread < threads; thread++) {
+                total_nodes += pool->threads[thread].nodes;
+            }
+        }
+
+        if (threads == 1) {
+            single_thread_time = total_time;
+        }
+
+        printf("    %7d   %18lld   %-12llu   %-10llu   %.2f\n", threads, total_time, total_nodes,
+               total_time ? total_nodes * 1000 / total_time : 0, total_time ? (double)single_thread_time / total_time : 0.0);
+        fflush(stdout);
+
+        destroy_search_pool(pool);
+    }
+
+    printf("\n");
+    destroy_position(pos);
+}
+
+/******************************************\
+===========================================
+
+                  UCI
+
+===========================================
+\******************************************/
+
+/*
+    UCI protocol front end -> the main thread reads & answers the commands on stdin, while every "go" runs on its own search
+    thread. That way "stop" & "isready" get answered straight away during a search, & the search never has to poll stdin.
+
+    Supported commands: uci, isready, ucinewgame, position startpos|fen <fen> [moves ...],
+                        go [depth <n>] [nodes <n>] [movetime <ms>] [wtime <ms>] [btime <ms>] [winc <ms>] [binc <ms>] [movestogo <n>] [infinite],
+                        stop, quit, setoption name Hash|Threads value <n>, setoption name EvalFile value <file>|<empty>
+*/
+
+// Default transposition table size (MB)
+#define DEFAULT_HASH_SIZE 64
+
+// Time kept back from every move for communication lag (ms)
+#define MOVE_OVERHEAD 50
+
+// UCI engine state
+typedef struct {
+    // Game position & the search threads working on it
+    position *pos;
+    search_pool *pool;
+    search_limits limits;
+
+    // Search thread & whether it's running
+    pthread_t search_thread;
+    int searching;
+
+    // Options
+    int hash_size;
+    int threads;
+} uci_engine;
+
+// Parse a move string (e.g. e7e8q) into a move of the current position -> 0 if there's no such move
+int parse_move(position *pos, char *move_string) {
+    // Generate the moves
+    moves move_list[1];
+    generate_moves(pos, move_list);
+
+    // Parse the source & target squares
+    if (move_string[0] < 'a' || move_string[0] > 'h' || move_string[1] < '1' || move_string[1] > '8' ||
+        move_string[2] < 'a' || move_string[2] > 'h' || move_string[3] < '1' || move_string[3] > '8') {
+        return 0;
+    }
+    int source_square = (move_string[0] - 'a') + (8 - (move_string[1] - '0')) * 8;
+    int target_square = (move_string[2] - 'a') + (8 - (move_string[3] - '0')) * 8;
+
+    // Look for the move in the move list
+    for (int count = 0; count < move_list->count; count++) {
+        int move = move_list->moves[count];
+
+        if (source_square == get_move_source(move) && target_square == get_move_target(move)) {
+            int promoted_piece = get_move_promoted(move);
+
+            // Not a promotion -> found it
+            if (!promoted_piece) {
+                return move;
+            }
+
+            // Promotion -> the promoted piece has to match too
+            if (promoted_pieces[promoted_piece] == move_string[4]) {
+                return move;
+            }
+        }
+    }
+
+    // Illegal move
+    return 0;
+}
+
+// Drop the oldest undo records once a long game fills up the undo stack -> only the records since the last irreversible move
+// are needed (for repetition detection), & no more than 100 of them (the search scores 100 half moves as a draw anyway)
+void trim_history(position *pos) {
+    // Still enough room for a search on top of the game
+    if (pos->undo_count < MAX_HISTORY - 2 * MAX_PLY) {
+        return;
+    }
+
+    // Keep the records since the last irreversible move
+    int keep = (pos->half_moves < pos->undo_count) ? pos->half_moves : pos->undo_count;
+    if (keep > 100) keep = 100;
+    memmove(pos->undo_stack, pos->undo_stack + pos->undo_count - keep, keep * sizeof(undo));
+    pos->undo_count = keep;
+}
+
+// Parse "position startpos|fen <fen> [moves ...]"
+void parse_position(position *pos, char *command) {
+    // Skip "position "
+    command += 9;
+
+    // Position to start from
+    if (!strncmp(command, "startpos", 8)) {
+        parse_fen(pos, start_position);
+    } else {
+        char *fen = strstr(command, "fen");
+        int error = (fen != NULL) ? parse_fen(pos, fen + 4) : fen_bad_board;
+        if (error != fen_ok) {
+            // Missing or malformed FEN -> start position
+            printf("info string invalid FEN (%s), using the start position\n", fen_error_names[error]);
+            parse_fen(pos, start_position);
+        }
+    }
+
+    // Play the moves
+    char *current = strstr(command, "moves");
+    if (current != NULL) {
+        current += 5;
+        while (*current == ' ') current++;
+        while (*current) {
+            // Stop if the undo stack has no room left for a search (trim_history should never let it get there)
+            if (pos->undo_count >= MAX_HISTORY - 2 * MAX_PLY) {
+                break;
+            }
+            int move = parse_move(pos, current);
+
+            // Stop at the first illegal move
+            if (!move || !make_move(pos, move, all_moves)) {
+                break;
+            }
+            trim_history(pos);
+
+            // Next move
+            while (*current && *current != ' ') current++;
+            while (*current == ' ') current++;
+        }
+    }
+}
+
+// Read the value after a "go" parameter -> -1 if the parameter isn't there
+static long long parse_go_value(char *command, char *parameter) {
+    char *argument = strstr(command, parameter);
+    return (argument != NULL) ? atoll(argument + strlen(parameter)) : -1;
+}
+
+// Search thread entry point
+static void *uci_search_thread(void *argument) {
+    uci_engine *engine = argument;
+    search_smp(engine->pool, engine->pos, &engine->limits);
+    return NULL;
+}
+
+// Wait for the running search to finish (after telling it to stop, if stop is set)
+void uci_wait_search(uci_engine *engine, int stop) {
+    if (engine->searching) {
+        if (stop) {
+            engine->limits.stopped = 1;
+        }
+        pthread_join(engine->search_thread, NULL);
+        engine->searching = 0;
+    }
+}
+
+// Parse "go ..." & start the search thread
+void parse_go(uci_engine *engine, char *command) {
+    search_limits *limits = &engine->limits;
+    position *pos = engine->pos;
+
+    // Time, increment & moves left for the side to move
+    long long time = parse_go_value(command, (pos->side == white) ? "wtime " : "btime ");
+    long long increment = parse_go_value(command, (pos->side == white) ? "winc " : "binc ");
+    long long moves_to_go = parse_go_value(command, "movestogo ");
+    long long move_time = parse_go_value(command, "movetime ");
+    long long depth = parse_go_value(command, "depth ");
+    long long nodes = parse_go_value(command, "nodes ");
+
+    // Default limits -> as deep as the search goes, no time limit
+    limits->depth = (depth > 0) ? ((depth < MAX_PLY) ? depth : MAX_PLY) : MAX_PLY;
+    limits->time_set = 0;
+    limits->nodes = (nodes > 0) ? nodes : 0;
+    limits->infinite = strstr(command, "infinite") != NULL;
+    limits->start_time = get_time_ms();
+
+    if (move_time >= 0) {
+        // Fixed time per move
+        limits->time_set = 1;
+        limits->stop_time = limits->start_time + move_time;
+    } else if (time >= 0) {
+        // Clock -> spread the time over the moves left (30 if the GUI doesn't say) & use half the increment on top
+        if (moves_to_go <= 0) {
+            moves_to_go = 30;
+        }
+        long long budget = time / moves_to_go + ((increment > 0) ? increment / 2 : 0);
+
+        // Never use more than what's left on the clock
+        if (budget > time - MOVE_OVERHEAD) {
+            budget = time - MOVE_OVERHEAD;
+        }
+        if (budget < 1) {
+            budget = 1;
+        }
+
+        limits->time_set = 1;
+        limits->stop_time = limits->start_time + budget;
+    }
+
+    // Start the search
+    limits->stopped = 0;
+    engine->searching = 1;
+    pthread_create(&engine->search_thread, NULL, uci_search_thread, engine);
+}
+
+// Parse "setoption name <name> value <value>"
+void parse_setoption(uci_engine *engine, char *command) {
+    char *value = strstr(command, "value ");
+    if (value == NULL) {
+        return;
+    }
+    int number = atoi(value + 6);
+
+    if (strstr(command, "name Hash")) {
+        // Transposition table size in MB
+        engine->hash_size = (number < 1) ? 1 : number;
+        tt_init(engine->hash_size);
+    } else if (strstr(command, "name Threads")) {
+        // Number of search threads
+        // Swap the pool only once the new one is there, so a failed allocation leaves a working engine
+        int threads = (number < 1) ? 1 : ((number > MAX_THREADS) ? MAX_THREADS : number);
+        search_pool *pool = create_search_pool(threads);
+        if (pool == NULL) {
+            printf("info string not enough memory for %d threads, keeping %d\n", threads, engine->threads);
+        } else {
+            destroy_search_pool(engine->pool);
+            engine->pool = pool;
+            engine->threads = threads;
+        }
+    } else if (strstr(command, "name EvalFile")) {
+        // NNUE network file -> <empty> goes back to the hand-written evaluation
+        char *path = value + 6;
+        int length = (int)strlen(path);
+        while (length > 0 && (path[length - 1] == ' ' || path[length - 1] == '\r' || path[length - 1] == '\n')) {
+            path[--length] = '\0';
+        }
+        if (!*path || !strcmp(path, "<empty>")) {
+            nnue_mode = nnue_off;
+        } else if (nnue_load(path)) {
+            nnue_refresh_accumulators(engine->pos);
+            printf("info string NNUE network %s loaded (%s)\n", path, nnue_kernel_name);
+        } else {
+            printf("info string can't load the NNUE network %s\n", path);
+        }
+    }
+}
+
+// Main UCI loop
+void uci_loop() {
+    // Unbuffered input, line buffered output
+    setvbuf(stdin, NULL, _IONBF, 0);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Set up the engine
+    uci_engine engine[1];
+    memset(engine, 0, sizeof(engine));
+    engine->pos = create_position();
+    engine->hash_size = DEFAULT_HASH_SIZE;
+    engine->threads = 1;
+    engine->pool = create_search_pool(engine->threads);
+    if (engine->pool == NULL) {
+        printf("info string not enough memory for the search\n");
+        destroy_position(engine->pos);
+        return;
+    }
+    tt_init(engine->hash_size);
+    parse_fen(engine->pos, start_position);
+
+    // Input buffer -> big enough for long move lists
+    static char input[16384];
+
+    // Main loop
+    while (1) {
+        // Read the next command (blocking is fine, the search runs on its own thread)
+        fflush(stdout);
+        if (!fgets(input, sizeof(input), stdin)) {
+            break;
+        }
+
+        // Drop the new line
+        input[strcspn(input, "\r\n")] = '\0';
+
+        if (!strncmp(input, "isready", 7)) {
+            printf("readyok\n");
+        } else if (!strncmp(input, "position", 8)) {
+            uci_wait_search(engine, 1);
+            parse_position(engine->pos, input);
+        } else if (!strncmp(input, "ucinewgame", 10)) {
+            uci_wait_search(engine, 1);
+            parse_fen(engine->pos, start_position);
+            tt_clear();
+        } else if (!strncmp(input, "go", 2)) {
+            uci_wait_search(engine, 1);
+            parse_go(engine, input);
+        } else if (!strncmp(input, "stop", 4)) {
+            uci_wait_search(engine, 1);
+        } else if (!strncmp(input, "quit", 4)) {
+            break;
+        } else if (!strncmp(input, "uci", 3)) {
+            printf("id name Highway Chess\n");
+            printf("id author DarkHaxDev\n");
+            printf("option name Hash type spin default %d min 1 max 65536\n", DEFAULT_HASH_SIZE);
+            printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+            printf("option name EvalFile type string default <empty>\n");
+            printf("uciok\n");
+        } else if (!strncmp(input, "setoption", 9)) {
+            uci_wait_search(engine, 1);
+            parse_setoption(engine, input);
+        } else if (!strncmp(input, "d", 1)) {
+            // Debug -> print the board
+            print_board(engine->pos);
+        }
+    }
+
+    // Stop the search & clean up
+    uci_wait_search(engine, 1);
+    destroy_position(engine->pos);
+    destroy_search_pool(engine->pool);
+}
+
+/******************************************\
+===========================================
+
+            Packed Positions
+
+===========================================
+\******************************************/
+
+/*
+    Packed position record -> 32 bytes instead of a 60 to 90 character FEN, & read back without any parsing:
+
+    occupancy     8 bytes   every occupied square (a8 = bit 0, like the bitboards)
+    pieces       16 bytes   a 4 bit code per occupied square in square order (low nibble first), so at most 32 pieces
+    half_moves    2 bytes   half & full move counters
+    full_moves    2 bytes
+    score         2 bytes   centipawns from the side to move's point of view (the EPD "ce" operation, 0 if unknown)
+    reserved      2 bytes   always 0
+
+    Piece codes 0 to 11 are the pieces (P to k). The side to move, castling rights & en passant square go into the codes
+    no piece uses:
+
+    12  rook that can still castle (white on a1 / h1, black on a8 / h8)
+    13  pawn that just moved 2 squares, so the square behind it is the en passant square
+    14  black king with black to move (no code 14 -> white to move)
+
+    A packed file is a 32 byte header (PACKED_MAGIC, the record count & the record size) followed by the records, so
+    record i sits at byte 32 + 32 * i & a mapped file can be indexed straight away. Everything is little endian.
+*/
+
+// Piece codes beyond the pieces (see above)
+#define PACKED_CASTLE_ROOK 12
+#define PACKED_ENPASSANT_PAWN 13
+#define PACKED_BLACK_KING_TO_MOVE 14
+
+// Packed file signature
+#define PACKED_MAGIC "BBHPOS01"
+
+// Packed position record
+typedef struct {
+    U64 occupancy;
+    unsigned char pieces[16];
+    unsigned short half_moves;
+    unsigned short full_moves;
+    short score;
+    unsigned short reserved;
+} packed_position;
+
+// Packed file header -> as big as a record, so the records stay aligned
+typedef struct {
+    char magic[8];
+    U64 count;
+    unsigned int record_size;
+    unsigned char reserved[12];
+} packed_header;
+
+_Static_assert(sizeof(packed_position) == 32 && sizeof(packed_header) == 32, "packed records & headers are 32 bytes");
+
+// Castling right a castling rook code stands for [square] -> 0 everywhere but the corners
+const unsigned char packed_castle_rights[64] = { [a8] = bq, [h8] = bk, [a1] = wq, [h1] = wk };
+
+// Pack a position -> 0 if it has more than 32 pieces. The score goes along as it is.
+int pack_position(position *pos, packed_position *record, int score) {
+    U64 occupancy = pos->occupancies[both];
+    if (count_bits(occupancy) > 32) {
+        return 0;
+    }
+
+    // Piece codes by square
+    unsigned char codes[64];
+    for (int piece = P; piece <= k; piece++) {
+        U64 bitboard = pos->bitboards[piece];
+        while (bitboard) {
+            int square = get_ls1b_index(bitboard);
+            codes[square] = piece;
+            pop_bit(bitboard, square);
+        }
+    }
+
+    // The state the pieces carry
+    if (pos->castle & wk) codes[h1] = PACKED_CASTLE_ROOK;
+    if (pos->castle & wq) codes[a1] = PACKED_CASTLE_ROOK;
+    if (pos->castle & bk) codes[h8] = PACKED_CASTLE_ROOK;
+    if (pos->castle & bq) codes[a8] = PACKED_CASTLE_ROOK;
+    if (pos->enpassant != no_sq) {
+        codes[(pos->side == white) ? pos->enpassant + 8 : pos->enpassant - 8] = PACKED_ENPASSANT_PAWN;
+    }
+    if (pos->side == black) {
+        codes[get_ls1b_index(pos->bitboards[k])] = PACKED_BLACK_KING_TO_MOVE;
+    }
+
+    // Nibbles in square order
+    memset(record, 0, sizeof(*record));
+    record->occupancy = occupancy;
+    for (int index = 0; occupancy; index++) {
+        int square = get_ls1b_index(occupancy);
+        record->pieces[index >> 1] |= codes[square] << ((index & 1) * 4);
+        pop_bit(occupancy, square);
+    }
+
+    record->half_moves = (pos->half_moves < 65535) ? pos->half_moves : 65535;
+    record->full_moves = (pos->full_moves < 65535) ? pos->full_moves : 65535;
+    record->score = (score < -32767) ? -32767 : ((score > 32767) ? 32767 : score);
+    return 1;
+}
+
+// Unpack a position -> fen_ok, or the error (& an empty board) if the record doesn't hold a valid position
+int unpack_position(position *pos, const packed_position *record) {
+    reset_board(pos);
+
+    U64 occupancy = record->occupancy;
+    if (count_bits(occupancy) > 32) {
+        return invalid_fen(pos, fen_bad_board);
+    }
+
+    for (int index = 0; occupancy; index++) {
+        int square = get_ls1b_index(occupancy);
+        int code = (record->pieces[index >> 1] >> ((index & 1) * 4)) & 15;
+        int piece = code;
+        pop_bit(occupancy, square);
+
+        if (code == PACKED_CASTLE_ROOK) {
+            // Castling rook -> only in a corner
+            if (!packed_castle_rights[square]) {
+                return invalid_fen(pos, fen_bad_castling);
+            }
+            pos->castle |= packed_castle_rights[square];
+            piece = (square <= h8) ? r : R;
+        } else if (code == PACKED_ENPASSANT_PAWN) {
+            // Double pushed pawn -> white on the 4th rank, black on the 5th, & only one of them
+            if (pos->enpassant != no_sq || ((square >> 3) != 3 && (square >> 3) != 4)) {
+                return invalid_fen(pos, fen_bad_enpassant);
+            }
+            piece = ((square >> 3) == 4) ? P : p;
+            pos->enpassant = (piece == P) ? square + 8 : square - 8;
+        } else if (code == PACKED_BLACK_KING_TO_MOVE) {
+            piece = k;
+            pos->side = black;
+        } else if (code > k) {
+            return invalid_fen(pos, fen_bad_board);
+        }
+
+        set_bit(pos->bitboards[piece], square);
+    }
+
+    // Occupancies
+    pos->occupancies[white] = pos->bitboards[P] | pos->bitboards[N] | pos->bitboards[B] |
+                              pos->bitboards[R] | pos->bitboards[Q] | pos->bitboards[K];
+    pos->occupancies[black] = pos->bitboards[p] | pos->bitboards[n] | pos->bitboards[b] |
+                              pos->bitboards[r] | pos->bitboards[q] | pos->bitboards[k];
+    pos->occupancies[both] = pos->occupancies[white] | pos->occupancies[black];
+
+    pos->half_moves = record->half_moves;
+    pos->full_moves = record->full_moves;
+
+    // Same checks as for a FEN
+    int error = position_error(pos);
+    if (error != fen_ok) {
+        return invalid_fen(pos, error);
+    }
+
+    // Hash keys & the incrementally updated evaluation terms
+    pos->hash_key = generate_hash_key(pos);
+    pos->pawn_key = generate_pawn_key(pos);
+    generate_evaluation(pos);
+    if (nnue_mode != nnue_off) {
+        nnue_refresh_accumulators(pos);
+    }
+
+    return fen_ok;
+}
+
+// Map a file into memory (read only) -> NULL if it can't be read
+static const char *map_file(const char *path, size_t *size) {
+    #ifdef _WIN64
+        FILE *file = fopen(path, "rb");
+        if (file == NULL) {
+            return NULL;
+        }
+        fseek(file, 0, SEEK_END);
+        *size = (size_t)_ftelli64(file);
+        fseek(file, 0, SEEK_SET);
+        char *data = malloc(*size + 1);
+        if (data != NULL && fread(data, 1, *size, file) != *size) {
+            free(data);
+            data = NULL;
+        }
+        fclose(file);
+        return data;
+    #else
+        int file = open(path, O_RDONLY);
+        if (file < 0) {
+            return NULL;
+        }
+        struct stat status;
+        if (fstat(file, &status) < 0) {
+            close(file);
+            return NULL;
+        }
+        *size = (size_t)status.st_size;
+
+        // Nothing to map in an empty file
+        if (*size == 0) {
+            close(file);
+            return "";
+        }
+
+        void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (data == MAP_FAILED) {
+            return NULL;
+        }
+        madvise(data, *size, MADV_SEQUENTIAL);
+        return data;
+    #endif
+}
+
+// Unmap a file from map_file
+static void unmap_file(const char *data, size_t size) {
+    #ifdef _WIN64
+        free((void *)data);
+    #else
+        if (size) {
+            munmap((void *)data, size);
+        }
+    #endif
+}
+
+// Next line of a text file -> NULL at the end of the file. Trailing whitespace (CR LF line ends) is cut off & blank lines
+// & lines starting with '#' are skipped.
+static const char *next_input_line(const char *data, size_t size, size_t *cursor, int *length) {
+    while (*cursor < size) {
+        const char *line = data + *cursor;
+        const char *newline = memchr(line, '\n', size - *cursor);
+        size_t line_length = (newline != NULL) ? (size_t)(newline - line) : size - *cursor;
+        *cursor += line_length + (newline != NULL);
+
+        while (line_length && (line[line_length - 1] == '\r' || line[line_length - 1] == ' ' || line[line_length - 1] == '\t')) {
+            line_length--;
+        }
+        if (line_length && *line != '#') {
+            *length = (int)line_length;
+            return line;
+        }
+    }
+    return NULL;
+}
+
+// The records of a mapped packed file -> NULL if it isn't one (wrong signature or record size, or cut short)
+static const packed_position *packed_records(const char *data, size_t size, U64 *count) {
+    const packed_header *header = (const packed_header *)data;
+    if (size < sizeof(packed_header) || memcmp(header->magic, PACKED_MAGIC, 8) ||
+        header->record_size != sizeof(packed_position) ||
+        header->count != (size - sizeof(packed_header)) / sizeof(packed_position) ||
+        (size - sizeof(packed_header)) % sizeof(packed_position)) {
+        return NULL;
+    }
+    *count = header->count;
+    return (const packed_position *)(data + sizeof(packed_header));
+}
+
+// Packed file writer -> appends records to a file & fills in the header's record count when it's closed
+typedef struct {
+    FILE *file;
+    U64 count;
+} packed_writer;
+
+// Start a packed file -> 0 if it can't be created
+int packed_writer_open(packed_writer *writer, const char *path) {
+    writer->count = 0;
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        return 0;
+    }
+
+    // Header with no records yet
+    packed_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKED_MAGIC, 8);
+    header.record_size = sizeof(packed_position);
+    return fwrite(&header, sizeof(header), 1, writer->file) == 1;
+}
+
+// Append a record -> 0 on a write error
+int packed_writer_write(packed_writer *writer, const packed_position *record) {
+    if (fwrite(record, sizeof(*record), 1, writer->file) != 1) {
+        return 0;
+    }
+    writer->count++;
+    return 1;
+}
+
+// Fill in the record count & close the file -> 0 on a write error
+int packed_writer_close(packed_writer *writer) {
+    int ok = !fseek(writer->file, offsetof(packed_header, count), SEEK_SET) &&
+             fwrite(&writer->count, sizeof(writer->count), 1, writer->file) == 1;
+    return !fclose(writer->file) && ok;
+}
+
+// Packed file reader -> the file gets mapped, so the records can be read in place, in any order
+typedef struct {
+    const char *data;
+    size_t size;
+    const packed_position *records;
+    U64 count;
+} packed_reader;
+
+// Open a packed file -> 0 if it can't be read or isn't a packed file
+int packed_reader_open(packed_reader *reader, const char *path) {
+    reader->data = map_file(path, &reader->size);
+    if (reader->data == NULL) {
+        return 0;
+    }
+    reader->records = packed_records(reader->data, reader->size, &reader->count);
+    if (reader->records == NULL) {
+        unmap_file(reader->data, reader->size);
+        return 0;
+    }
+    return 1;
+}
+
+// Close a packed file
+void packed_reader_close(packed_reader *reader) {
+    unmap_file(reader->data, reader->size);
+}
+
+// Find the value of the EPD "ce" (centipawn evaluation) operation in a line -> 0 if there's none
+static int epd_centipawns(const char *line, int length) {
+    for (int index = 0; index + 3 < length; index++) {
+        if (line[index] == 'c' && line[index + 1] == 'e' && line[index + 2] == ' ' &&
+            index && (line[index - 1] == ' ' || line[index - 1] == ';')) {
+            int sign = 1, value = 0;
+            index += 3;
+            if (line[index] == '-' || line[index] == '+') {
+                sign = (line[index++] == '-') ? -1 : 1;
+            }
+            for (int digits = 0; index < length && line[index] >= '0' && line[index] <= '9' && digits < 6; digits++) {
+                value = value * 10 + (line[index++] - '0');
+            }
+            return sign * value;
+        }
+    }
+    return 0;
+}
+
+// Convert an EPD (or FEN) file into a packed file -> every position parsed, packed, unpacked again & checked. Lines that
+// don't hold a valid position (or hold more than 32 pieces) get skipped. Returns 0 on success, 1 if a file can't be opened
+// or written, 2 if a record doesn't unpack to the position it came from.
+int pack_epd_file(const char *input_path, const char *output_path) {
+    size_t size;
+    const char *data = map_file(input_path, &size);
+    if (data == NULL) {
+        fprintf(stderr, "can't read %s\n", input_path);
+        return 1;
+    }
+
+    packed_writer writer[1];
+    if (!packed_writer_open(writer, output_path)) {
+        fprintf(stderr, "can't write %s\n", output_path);
+        unmap_file(data, size);
+        return 1;
+    }
+
+    position *pos = create_position();
+    position *check = create_position();
+    U64 lines = 0, skipped = 0, mismatches = 0;
+    int result = 0;
+    long long start = get_time_ms();
+
+    size_t cursor = 0;
+    const char *line;
+    int length;
+    while ((line = next_input_line(data, size, &cursor, &length)) != NULL) {
+        lines++;
+        packed_position record;
+        if (parse_fen_length(pos, line, length) != fen_ok || !pack_position(pos, &record, epd_centipawns(line, length))) {
+            skipped++;
+            continue;
+        }
+
+        // Round trip check
+        if (unpack_position(check, &record) != fen_ok || check->hash_key != pos->hash_key ||
+            check->half_moves != pos->half_moves || check->full_moves != pos->full_moves) {
+            if (!mismatches++) fprintf(stderr, "packed record doesn't match: %.*s\n", length, line);
+        }
+
+        if (!packed_writer_write(writer, &record)) {
+            result = 1;
+            break;
+        }
+    }
+
+    if (!packed_writer_close(writer) || result) {
+        fprintf(stderr, "can't write %s\n", output_path);
+        result = 1;
+    } else if (mismatches) {
+        result = 2;
+    }
+
+    long long elapsed = get_time_ms() - start;
+    fprintf(stderr, "pack: %llu lines, %llu packed, %llu skipped, %llu mismatches, %zu -> %llu bytes, %lld ms\n",
+            lines, writer->count, skipped, mismatches, size, (U64)(sizeof(packed_header) + writer->count * sizeof(packed_position)), elapsed);
+
+    destroy_position(check);
+    destroy_position(pos);
+    unmap_file(data, size);
+    return result;
+}
+
+// Write the positions of a packed file as FENs (with a "ce" operation if the record has a score) to the output file
+// (stdout if NULL) -> 0 on success, 1 if a file can't be opened. The unpacking speed goes to stderr.
+int unpack_file(const char *input_path, const char *output_path) {
+    packed_reader reader[1];
+    if (!packed_reader_open(reader, input_path)) {
+        fprintf(stderr, "can't read %s as a packed file\n", input_path);
+        return 1;
+    }
+
+    FILE *output = (output_path != NULL) ? fopen(output_path, "wb") : stdout;
+    if (output == NULL) {
+        fprintf(stderr, "can't write %s\n", output_path);
+        packed_reader_close(reader);
+        return 1;
+    }
+
+    // Unpack only -> how fast positions come out of the file
+    position *pos = create_position();
+    U64 checksum = 0, invalid = 0;
+    long long start = get_time_ms();
+    for (U64 index = 0; index < reader->count; index++) {
+        invalid += unpack_position(pos, &reader->records[index]) != fen_ok;
+        checksum ^= pos->hash_key;
+    }
+    long long elapsed = get_time_ms() - start;
+
+    // Write the FENs
+    for (U64 index = 0; index < reader->count; index++) {
+        char fen[FEN_MAX_LENGTH + 1];
+        if (unpack_position(pos, &reader->records[index]) != fen_ok) {
+            fputs("invalid\n", output);
+            continue;
+        }
+        position_to_fen(pos, fen, sizeof(fen));
+        if (reader->records[index].score) {
+            fprintf(output, "%s ce %d;\n", fen, reader->records[index].score);
+        } else {
+            fprintf(output, "%s\n", fen);
+        }
+    }
+    if (output != stdout) {
+        fclose(output);
+    }
+
+    fprintf(stderr, "unpack: %llu positions (%llu invalid), %lld ms, %.2f M positions/s (checksum %llx)\n", reader->count,
+            invalid, elapsed, elapsed ? reader->count / 1000.0 / elapsed : 0.0, checksum & 0xffff);
+
+    destroy_position(pos);
+    packed_reader_close(reader);
+    return 0;
+}
+
+/******************************************\
+===========================================
+
+             Batch Analysis
+
+===========================================
+\******************************************/
+
+/*
+    Batch analysis -> searches every position of an EPD or FEN file (one per line, blank lines & lines starting with '#'
+    skipped) & writes one tab separated result line per position, in input order:
+
+        <the line as given>   <best move | (none)>   <score: cp <n> | mate <n>>   <nodes>   <depth>
+        <the line as given>   invalid   <what's wrong with it (see fen_error_names)>
+
+    The file gets mapped into memory (read into one buffer on Windows), so the lines are parsed straight out of it with
+    parse_fen_length & never copied or allocated. A packed file (see Packed Positions) works too: its records get unpacked
+    in place & the result lines start with the position's FEN. Every worker thread owns a position & a 1 thread search pool & claims the
+    next line under the batch lock. The results go into a ring of slots: whichever worker finishes the oldest outstanding
+    line writes out everything that's ready from there on, & a worker that gets a whole ring ahead of the output waits.
+    The workers share the transposition table, so with more than one thread the node counts aren't exactly reproducible.
+*/
+
+// Result slots -> how far the workers can get ahead of the oldest line that isn't written out yet
+#define BATCH_RING_SIZE 1024
+
+// Result of one line
+typedef struct {
+    // The line in the input file, or the record in a packed file (the line is then the FEN written into fen)
+    const char *line;
+    int length;
+    const packed_position *record;
+    char fen[FEN_MAX_LENGTH + 1];
+
+    // Set once the worker is done with the line
+    int ready;
+
+    // Search result (only if the line parsed, see parse_fen_length)
+    int error;
+    int best_move;
+    int score;
+    int depth;
+    U64 nodes;
+} batch_result;
+
+// Batch analysis job -> shared by all the workers
+typedef struct {
+    // Input file & the next byte to read, or its records if it's a packed file
+    const char *data;
+    size_t size;
+    size_t cursor;
+    const packed_position *records;
+    U64 record_count;
+
+    // Lines handed out & lines written out
+    U64 next_line;
+    U64 written_lines;
+
+    // Limits for every position (0 = none)
+    int depth;
+    U64 nodes;
+    int movetime;
+
+    // Output stream & totals
+    FILE *output;
+    U64 invalid_lines;
+    U64 total_nodes;
+
+    // Workers that couldn't get their search memory (they never claim a line, so the others pick up the work)
+    int failed_workers;
+
+    // Lock over everything above & the results, signalled whenever lines get written out
+    pthread_mutex_t lock;
+    pthread_cond_t written;
+
+    batch_result results[BATCH_RING_SIZE];
+} batch_job;
+
+// Write a result line
+static void write_batch_result(FILE *output, batch_result *result) {
+    fwrite(result->line, 1, result->length, output);
+    if (result->error != fen_ok) {
+        fprintf(output, "\tinvalid\t%s\n", fen_error_names[result->error]);
+        return;
+    }
+
+    char move[8] = "(none)";
+    if (result->best_move) {
+        move_to_string(result->best_move, move);
+    }
+    fprintf(output, "\t%s\t", move);
+    fprint_score(output, result->score);
+    fprintf(output, "\t%llu\t%d\n", result->nodes, result->depth);
+}
+
+// Claim the next line to analyse -> NULL once the file is done. Called with the lock held.
+static batch_result *claim_batch_line(batch_job *job) {
+    // Don't get a whole ring ahead of the output
+    while (job->next_line - job->written_lines >= BATCH_RING_SIZE) {
+        pthread_cond_wait(&job->written, &job->lock);
+    }
+
+    // Packed file -> the next record
+    if (job->records != NULL) {
+        if (job->next_line >= job->record_count) {
+            return NULL;
+        }
+        batch_result *result = &job->results[job->next_line % BATCH_RING_SIZE];
+        result->record = &job->records[job->next_line++];
+        return result;
+    }
+
+    // Text file -> the next line
+    int length;
+    const char *line = next_input_line(job->data, job->size, &job->cursor, &length);
+    if (line == NULL) {
+        return NULL;
+    }
+
+    batch_result *result = &job->results[job->next_line++ % BATCH_RING_SIZE];
+    result->line = line;
+    result->length = length;
+    result->record = NULL;
+    return result;
+}
+
+// Batch worker thread -> analyses lines until the file is done
+static void *batch_worker(void *argument) {
+    batch_job *job = argument;
+
+    // Own board & search data -> without it, bow out before claiming anything so no line is left unwritten
+    search_pool *pool = create_search_pool(1);
+    if (pool == NULL) {
+        pthread_mutex_lock(&job->lock);
+        job->failed_workers++;
+        pthread_mutex_unlock(&job->lock);
+        return NULL;
+    }
+    search_data *data = &pool->threads[0];
+    search_limits limits;
+    memset(&limits, 0, sizeof(limits));
+    limits.silent = 1;
+    data->limits = &limits;
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        batch_result *result = claim_batch_line(job);
+        pthread_mutex_unlock(&job->lock);
+        if (result == NULL) {
+            break;
+        }
+
+        // Parse (or unpack) the position straight out of the file & search it
+        if (result->record != NULL) {
+            result->error = unpack_position(data->pos, result->record);
+            result->length = (result->error == fen_ok) ? position_to_fen(data->pos, result->fen, sizeof(result->fen)) : 0;
+            result->line = result->fen;
+        } else {
+            result->error = parse_fen_length(data->pos, result->line, result->length);
+        }
+        if (result->error == fen_ok) {
+            limits.depth = job->depth ? job->depth : MAX_PLY;
+            limits.nodes = job->nodes;
+            limits.time_set = job->movetime > 0;
+            limits.start_time = get_time_ms();
+            limits.stop_time = limits.start_time + job->movetime;
+            limits.stopped = 0;
+
+            result->best_move = search_position(data);
+            result->score = data->best_score;
+            result->depth = data->completed_depth;
+            result->nodes = data->nodes;
+        }
+
+        // Hand the result in & write out everything that's ready in input order
+        pthread_mutex_lock(&job->lock);
+        result->ready = 1;
+        job->total_nodes += (result->error == fen_ok) ? result->nodes : 0;
+        job->invalid_lines += (result->error != fen_ok);
+
+        int written = 0;
+        while (job->written_lines < job->next_line) {
+            batch_result *next = &job->results[job->written_lines % BATCH_RING_SIZE];
+            if (!next->ready) {
+                break;
+            }
+            write_batch_result(job->output, next);
+            next->ready = 0;
+            job->written_lines++;
+            written = 1;
+        }
+        if (written) {
+            pthread_cond_broadcast(&job->written);
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    destroy_search_pool(pool);
+    return NULL;
+}
+
+// Analyse every position of an EPD, FEN or packed file to a fixed depth, node count or time (0 = no limit; depth 10 if there's
+// none at all) with the given number of threads (0 = all cores) -> results to the output file (stdout if NULL) & a summary
+// to stderr. Returns 0 on success, 1 if a file can't be opened or no worker could get its memory.
+int batch_analysis(const char *input_path, const char *output_path, int depth, U64 nodes, int movetime, int threads) {
+    // Clamp the number of threads
+    if (threads <= 0) threads = get_cpu_count();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    batch_job *job = aligned_calloc(1, sizeof(batch_job));
+    if (job == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    job->depth = (depth || nodes || movetime) ? depth : 10;
+    job->nodes = nodes;
+    job->movetime = movetime;
+
+    job->data = map_file(input_path, &job->size);
+    if (job->data == NULL) {
+        fprintf(stderr, "can't read %s\n", input_path);
+        aligned_free(job);
+        return 1;
+    }
+    job->records = packed_records(job->data, job->size, &job->record_count);
+
+    job->output = (output_path != NULL) ? fopen(output_path, "wb") : stdout;
+    if (job->output == NULL) {
+        fprintf(stderr, "can't write %s\n", output_path);
+        unmap_file(job->data, job->size);
+        aligned_free(job);
+        return 1;
+    }
+
+    // Big output buffer -> the result lines get written under the lock
+    char *output_buffer = malloc(1 << 20);
+    if (output_buffer == NULL) {
+        fprintf(stderr, "out of memory\n");
+        if (job->output != stdout) fclose(job->output);
+        unmap_file(job->data, job->size);
+        aligned_free(job);
+        return 1;
+    }
+    setvbuf(job->output, output_buffer, _IOFBF, 1 << 20);
+
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->written, NULL);
+    tt_new_search();
+
+    // Run the workers
+    long long start_time = get_time_ms();
+    pthread_t workers[MAX_THREADS];
+    for (int thread = 0; thread < threads; thread++) {
+        pthread_create(&workers[thread], NULL, batch_worker, job);
+    }
+    for (int thread = 0; thread < threads; thread++) {
+        pthread_join(workers[thread], NULL);
+    }
+    long long elapsed = get_time_ms() - start_time;
+
+    // Flush before the buffer goes away
+    if (job->output != stdout) {
+        fclose(job->output);
+    } else {
+        fflush(stdout);
+        setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+    }
+    free(output_buffer);
+
+    fprintf(stderr, "batch: %llu positions (%llu invalid), %d threads, %llu nodes, %lld ms, %.1f positions/s\n",
+            job->written_lines, job->invalid_lines, threads, job->total_nodes, elapsed,
+            elapsed ? job->written_lines * 1000.0 / elapsed : 0.0);
+
+    // Workers without search memory -> the rest did their lines, but if none could, nothing got analysed
+    int result = 0;
+    if (job->failed_workers) {
+        fprintf(stderr, "batch: not enough memory for %d of the %d threads\n", job->failed_workers, threads);
+        result = (job->failed_workers == threads);
+    }
+
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->written);
+    unmap_file(job->data, job->size);
+    aligned_free(job);
+    return result;
+}
+
+/******************************************\
+===========================================
+
+            Initialize All
+
+===========================================
+\******************************************/
 
 void initialize_all() {
     // initialize unicode stuff
     enable_unicode_support();
 
+#ifndef GENERATED_TABLES
     // initialize leaper pieces atacks
     init_leapers_attacks();
-    
 
-    // initialize magic numbers
-    // initialize_magic_numbers();
+    // Initialize the between & line tables
+    init_line_tables();
+#endif
+
+    // Initialize the Zobrist hash keys
+    init_random_keys();
 
+    // Initialize the packed material & piece-square scores (see Incremental Evaluation)
+    init_piece_square_values();
+    
+#ifndef GENERATED_TABLES
     // Initialize slider attacks
     init_slider_attacks(bishop);
     // printf("hello world");
     init_slider_attacks(rook);
     // printf("hello world");
+#ifdef SHARED_SLIDER_TABLE
+    // Share the slider attack sets (see build_shared_slider_table)
+    build_shared_slider_table(slider_attacks, bishop_offset, rook_offset, slider_references, slider_attack_sets);
+#endif
+#endif
+
+    // Pick the slider backend -> PEXT if the CPU has BMI2 & doesn't microcode pext (see Slider Backends)
+    set_slider_backend(cpu_prefers_pext() ? slider_pext : slider_magic);
+
+    // Pick the fill attack generator -> AVX2 if the CPU has it (see Fill Attacks)
+    init_fill_attacks();
+
+    // Pick the NNUE kernels -> AVX2, then SSE4.1 (see NNUE)
+    init_nnue();
 }
 
 /******************************************\
@@ -1374,9 +8175,197 @@ void initialize_all() {
 ===========================================
 \******************************************/
 
-int main() {
+/*
+    Command line modes
+
+    bbHighway                                   -> UCI mode (see UCI)
+    bbHighway perft <depth> [hash <mb>] [threads <n>] [backend magic|pext] [movegen legal|pseudo]
+                                                -> bulk-counting perft over the debug positions & check the node counts
+                                                   (optionally with a perft hash table of the given size, spread over
+                                                   n threads, 0 = all cores, with the given slider backend & with the
+                                                   legal (default) or pseudo-legal move generator)
+    bbHighway perft plain <depth>               -> same, but every leaf move gets made (measures make/take back)
+    bbHighway perft divide <depth> [fen]        -> node count below every root move (start position if no FEN is given)
+    bbHighway search <depth> [fen]              -> search to a fixed depth & print the best move
+    bbHighway search movetime <ms> [fen]        -> search for a fixed time & print the best move
+    bbHighway smpbench <depth> [max_threads]    -> Lazy SMP scaling benchmark with 1, 2, 4, ... threads (16 by default)
+    bbHighway slidebench [millions]             -> slider table layouts compared (back to back vs shared entry)
+    bbHighway fillbench [millions]              -> fill attack generators compared with slider lookups
+    bbHighway seebench [millions]               -> static exchange evaluations per second on the tricky & killer positions
+    bbHighway fenbench [millions]               -> FENs parsed & written per second (& a round trip check)
+    bbHighway nnuebench [millions] [file]       -> NNUE evaluations per second, incremental vs refreshed accumulators
+                                                   (random weights if no network file is given)
+    bbHighway pack <epd file> <packed file>     -> convert an EPD/FEN file into a packed file (see Packed Positions)
+    bbHighway unpack <packed file> [out file]   -> write a packed file's positions as FENs (& time the unpacking)
+    bbHighway batch <file> [depth <n>] [nodes <n>] [movetime <ms>] [threads <n>] [hash <mb>] [out <file>]
+                                                -> search every position of an EPD/FEN/packed file & write the results in input
+                                                   order (see Batch Analysis; depth 10, all cores & stdout by default)
+*/
+int main(int argc, char *argv[]) {
     // Initialize everything
     initialize_all();
 
-    return 0;
+#ifdef GENERATE_TABLES
+    // Table generator build (make tables) -> fill the PEXT table too (the engine only builds it on demand), write the attack tables & exit
+    init_pext_attacks();
+    return write_attack_tables((argc >= 2) ? argv[1] : "attack_tables.h");
+#endif
+
+#ifdef GENERATE_MAGICS
+    // Magic number search build (make magics) -> search, write the magic numbers & exit
+    return magic_search_main(argc, argv);
+#endif
+
+    // Board to work on
+    position *pos = create_position();
+
+    // Exit code
+    int result = 0;
+
+    // Perft modes
+    if (argc >= 2 && !strcmp(argv[1], "perft")) {
+        if (argc >= 4 && !strcmp(argv[2], "divide")) {
+            // Perft divide
+            parse_fen(pos, (argc >= 5) ? argv[4] : start_position);
+            print_board(pos);
+            perft_divide(pos, atoi(argv[3]));
+        } else if (argc >= 3 && !strcmp(argv[2], "plain")) {
+            // Plain perft suite -> non-zero exit code on a node count mismatch
+            result = perft_test_suite(pos, (argc >= 4) ? atoi(argv[3]) : 4, perft_plain, 1) ? 1 : 0;
+        } else {
+            // Bulk-counting perft suite options
+            int threads = 1;
+            for (int arg = 3; arg + 1 < argc; arg += 2) {
+                if (!strcmp(argv[arg], "hash")) {
+                    perft_hash_init(atoi(argv[arg + 1]));
+                } else if (!strcmp(argv[arg], "threads")) {
+                    threads = atoi(argv[arg + 1]);
+                    if (threads <= 0) threads = get_cpu_count();
+                } else if (!strcmp(argv[arg], "movegen")) {
+                    perft_movegen = !strcmp(argv[arg + 1], "pseudo") ? movegen_pseudo_legal : movegen_legal;
+                } else if (!strcmp(argv[arg], "backend")) {
+                    int backend = !strcmp(argv[arg + 1], "pext") ? slider_pext : slider_magic;
+                    if (!set_slider_backend(backend)) {
+                        printf("    This CPU can't run the %s backend, using %s\n", slider_backend_names[backend], slider_backend_names[slider_backend]);
+                    }
+                }
+            }
+
+            // Bulk-counting perft suite
+            result = perft_test_suite(pos, (argc >= 3) ? atoi(argv[2]) : 4, perft_bulk_count, threads) ? 1 : 0;
+        }
+    }
+
+    // Search modes
+    if (argc >= 3 && !strcmp(argv[1], "search")) {
+        // Search limits -> fixed depth or fixed time
+        search_limits limits = { .depth = MAX_PLY };
+        int fen_arg = 3, movetime = 0;
+        if (!strcmp(argv[2], "movetime") && argc >= 4) {
+            limits.time_set = 1;
+            movetime = atoi(argv[3]);
+            fen_arg = 4;
+        } else {
+            limits.depth = atoi(argv[2]);
+        }
+
+        // Set up the position
+        parse_fen(pos, (argc > fen_arg) ? argv[fen_arg] : start_position);
+        print_board(pos);
+
+        // Search
+        tt_init(64);
+        search_pool *pool = create_search_pool(1);
+        if (pool == NULL) {
+            printf("Not enough memory for the search\n");
+            result = 1;
+        } else {
+            limits.start_time = get_time_ms();
+            limits.stop_time = limits.start_time + movetime;
+            search_smp(pool, pos, &limits);
+            destroy_search_pool(pool);
+        }
+    }
+
+    // Lazy SMP scaling benchmark
+    if (argc >= 3 && !strcmp(argv[1], "smpbench")) {
+        tt_init(DEFAULT_HASH_SIZE);
+        smp_benchmark(atoi(argv[2]), (argc >= 4) ? atoi(argv[3]) : 16);
+    }
+
+    // Slider table layout benchmark
+    if (argc >= 2 && !strcmp(argv[1], "slidebench")) {
+        slider_benchmark((argc >= 3) ? atoi(argv[2]) : 100);
+    }
+
+    // Fill attack benchmark
+    if (argc >= 2 && !strcmp(argv[1], "fillbench")) {
+        fill_benchmark((argc >= 3) ? atoi(argv[2]) : 20);
+    }
+
+    // SEE benchmark
+    if (argc >= 2 && !strcmp(argv[1], "seebench")) {
+        see_benchmark((argc >= 3) ? atoi(argv[2]) : 20);
+    }
+
+    // FEN benchmark
+    if (argc >= 2 && !strcmp(argv[1], "fenbench")) {
+        fen_benchmark((argc >= 3) ? atoi(argv[2]) : 5);
+    }
+
+    // TT pack & unpack test
+    if (argc >= 2 && !strcmp(argv[1], "tttest")) {
+        return tt_pack_test() ? 1 : 0;
+    }
+
+    // NNUE benchmark
+    if (argc >= 2 && !strcmp(argv[1], "nnuebench")) {
+        nnue_benchmark((argc >= 3) ? atoi(argv[2]) : 1, (argc >= 4) ? argv[3] : NULL);
+    }
+
+    // Batch analysis
+    if (argc >= 3 && !strcmp(argv[1], "batch")) {
+        int depth = 0, movetime = 0, threads = 0, hash_size = DEFAULT_HASH_SIZE;
+        U64 nodes = 0;
+        char *output_path = NULL;
+        for (int arg = 3; arg + 1 < argc; arg += 2) {
+            if (!strcmp(argv[arg], "depth")) {
+                depth = atoi(argv[arg + 1]);
+            } else if (!strcmp(argv[arg], "nodes")) {
+                nodes = strtoull(argv[arg + 1], NULL, 10);
+            } else if (!strcmp(argv[arg], "movetime")) {
+                movetime = atoi(argv[arg + 1]);
+            } else if (!strcmp(argv[arg], "threads")) {
+                threads = atoi(argv[arg + 1]);
+            } else if (!strcmp(argv[arg], "hash")) {
+                hash_size = atoi(argv[arg + 1]);
+            } else if (!strcmp(argv[arg], "out")) {
+                output_path = argv[arg + 1];
+            }
+        }
+        if (depth > MAX_PLY) depth = MAX_PLY;
+
+        tt_init((hash_size < 1) ? 1 : hash_size);
+        result = batch_analysis(argv[2], output_path, depth, nodes, movetime, threads);
+    }
+
+    // Packed position files
+    if (argc >= 4 && !strcmp(argv[1], "pack")) {
+        result = pack_epd_file(argv[2], argv[3]);
+    }
+    if (argc >= 3 && !strcmp(argv[1], "unpack")) {
+        result = unpack_file(argv[2], (argc >= 4) ? argv[3] : NULL);
+    }
+
+    // No command line mode -> talk UCI
+    if (argc < 2) {
+        uci_loop();
+    }
+
+    // Clean up
+    destroy_position(pos);
+    aligned_free(tt_table);
+    perft_hash_init(0);
+
+    return result;
 }